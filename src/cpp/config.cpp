@@ -11,17 +11,46 @@ std::string Configure::ToString() const {
   s << "number of features = " << number_of_feature << std::endl
     << "min leaf size = " << min_leaf_size << std::endl
     << "maximum depth = " << max_depth << std::endl
+    << "maximum leaves = " << max_leaves << std::endl
     << "iterations = " << iterations << std::endl
     << "shrinkage = " << shrinkage << std::endl
     << "feature sample ratio = " << feature_sample_ratio << std::endl
     << "data sample ratio = " << data_sample_ratio << std::endl
+    << "goss enabled = " << enable_goss << std::endl
+    << "goss top ratio = " << goss_top_ratio << std::endl
+    << "goss other ratio = " << goss_other_ratio << std::endl
     << "debug enabled = " << debug << std::endl
     << "loss type = " << (loss.get()? loss->GetName() : "NA") << std::endl
+    << "newton enabled = " << enable_newton << std::endl
+    << "l2 regularization = " << l2_regularization << std::endl
     << "feature tuning enabled = " << enable_feature_tunning << std::endl
-    << "initial guess enabled = " << enable_initial_guess << std::endl;
+    << "initial guess enabled = " << enable_initial_guess << std::endl
+    << "histogram enabled = " << enable_histogram << std::endl
+    << "max bins = " << max_bins << std::endl
+    << "feature bundling enabled = " << enable_feature_bundling << std::endl
+    << "quick scorer enabled = " << enable_quick_scorer << std::endl
+    << "sparse input enabled = " << enable_sparse_input << std::endl;
   return s.str();
 }
 
+bool Configure::Validate(std::string *error) const {
+  if (enable_goss) {
+    if (!(goss_top_ratio > 0 && goss_top_ratio <= 1)) {
+      *error = "goss top ratio should be in (0, 1]";
+      return false;
+    }
+    if (!(goss_other_ratio > 0 && goss_other_ratio <= 1)) {
+      *error = "goss other ratio should be in (0, 1]";
+      return false;
+    }
+    if (goss_top_ratio + goss_other_ratio > 1) {
+      *error = "goss top ratio plus goss other ratio should be at most 1";
+      return false;
+    }
+  }
+  return true;
+}
+
 // each row of cost file is formated as follows:
 // feature_index:feature_cost
 // e.g.:
@@ -19,14 +19,22 @@ class Configure {
  public:
   int number_of_feature;      // number of features
   int max_depth;              // max depth for each tree
+  int max_leaves;             // when positive, trees grow leaf-wise to at most `max_leaves' leaves
   int iterations;             // number of trees in gbdt
   double shrinkage;               // shrinkage parameter
   double feature_sample_ratio;    // portion of features to be splited
   double data_sample_ratio;       // portion of data to be fitted in each iteration
   int min_leaf_size;          // min number of nodes in leaf
 
+  bool enable_goss;               // when set true, `data_sample_ratio' is replaced by gradient-based one-side sampling
+  double goss_top_ratio;          // portion of data with the largest gradients, always fitted in GOSS
+  double goss_other_ratio;        // portion of data sampled from the rest in GOSS
+
   std::shared_ptr<Objective> loss; // loss type
 
+  bool enable_newton;             // when set true, trees are fitted by Newton steps if `loss' has a hessian
+  double l2_regularization;       // L2 penalty on leaf values of Newton steps
+
   bool debug;                    // show debug info?
 
   std::vector<double> feature_costs;         // mannually set feature costs in order to tune the model
@@ -34,14 +42,32 @@ class Configure {
 
   bool enable_initial_guess;
 
+  bool enable_histogram;         // when set true, find splits on quantized feature histograms
+  int max_bins;                  // max number of bins for each feature in histogram mode
+  bool enable_feature_bundling;  // when set true, mutually exclusive features share bin columns in histogram mode
+
+  bool enable_quick_scorer;      // when set true, a loaded model predicts with `QuickScorer'
+  bool enable_sparse_input;      // when set true, a forest of the used features only is built for sparse tuples
+
   Configure():
+      max_leaves(0),
       feature_sample_ratio(1),
       data_sample_ratio(1),
       min_leaf_size(0),
+      enable_goss(false),
+      goss_top_ratio(0.2),
+      goss_other_ratio(0.1),
       loss(NULL),
+      enable_newton(false),
+      l2_regularization(1),
       debug(false),
       enable_feature_tunning(false),
-      enable_initial_guess(false) {}
+      enable_initial_guess(false),
+      enable_histogram(false),
+      max_bins(255),
+      enable_feature_bundling(false),
+      enable_quick_scorer(false),
+      enable_sparse_input(false) {}
 
   ~Configure() {}
 
@@ -51,6 +77,11 @@ class Configure {
     enable_feature_tunning = false;
   }
 
+  // Check the options that would otherwise fail an assertion or
+  // train silently wrong, e.g. GOSS ratios; on failure `error' tells
+  // which one.
+  bool Validate(std::string *error) const;
+
   std::string ToString() const;
 };
 }
@@ -1,49 +1,32 @@
 #include "custom_loss_example.hpp"
 
-namespace {
-struct ResidualCompare {
-  bool operator () (const gbdt::Tuple *t1, const gbdt::Tuple *t2) {
-    return t1->residual < t2->residual;
-  }
-};
-}
-
 namespace gbdt {
 
 double MyLoss::GetRegionPrediction(DataVector &d, size_t len) const {
-  std::sort(d.begin(), d.begin()+len, ResidualCompare());
+  // The residual at which `j+2*i-m-n' turns positive, where `i' and `j'
+  // are the weights of group A and group B up to it in ascending order,
+  // `n' and `m' the total weights: weight 2 of group A and weight 1 of
+  // group B add up beyond `m+n'.
+  std::vector<WeightedValue> values(len);
   double n = 0, m = 0;
-  int k = 0;
-  for (k = 0; k < len; ++k) {
+  for (size_t k = 0; k < len; ++k) {
+    values[k].value = d[k]->residual;
     if (d[k]->label >= 0) {
+      values[k].weight = 2 * d[k]->weight;
       n += d[k]->weight;
     } else {
+      values[k].weight = d[k]->weight;
       m += d[k]->weight;
     }
   }
 
   double r = 0.0;
-  double i = 0, j = 0;
-  for (k = 0; k < len; ++k) {
-    if (d[k]->label >= 0) {
-      i += d[k]->weight;
-    } else {
-      j += d[k]->weight;
-    }
-
-    if (j+2*i-m-n > 0) {
-      break;
+  if (!WeightedSelect(&values, m + n, &r)) {
+    // never turns positive, the largest residual
+    for (size_t k = 0; k < len; ++k) {
+      r = k == 0? values[k].value : std::max(r, values[k].value);
     }
   }
-
-  if (k >= len) {
-    r = d[k-1]->residual;
-  } else if (k-1 >= 0) {
-    r = (d[k]->residual + d[k-1]->residual) / 2.0;
-  } else {
-    r = d[k]->residual;
-  }
-
   return r;
 }
 
@@ -3,6 +3,8 @@
 #include "data.hpp"
 #include <fstream>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 
 
 namespace gbdt {
@@ -11,9 +13,6 @@ static const std::string kKVDelimiter = ":";
 
 std::string Tuple::ToString(int number_of_feature,
                             bool output_initial_guess) const {
-  if (feature == NULL)
-    return std::string();
-
   std::string result;
   if (output_initial_guess) {
     result += std::to_string(initial_guess);
@@ -23,6 +22,16 @@ std::string Tuple::ToString(int number_of_feature,
   result += kItemDelimiter;
   result += std::to_string(weight);
 
+  if (!feature) {
+    for (size_t i = 0; i < known.size(); ++i) {
+      result += kItemDelimiter;
+      result += std::to_string(known[i].first);
+      result += kKVDelimiter;
+      result += std::to_string(known[i].second);
+    }
+    return result;
+  }
+
   for (int i = 0; i < number_of_feature; ++i) {
     if (feature[i] == kUnknownValue)
       continue;
@@ -35,48 +44,266 @@ std::string Tuple::ToString(int number_of_feature,
   return result;
 }
 
-Tuple* Tuple::FromString(const std::string &l,
-                         int number_of_feature,
-                         bool two_class_classification,
-                         bool load_initial_guess) {
-  Tuple* result = new Tuple();
-  size_t n = number_of_feature;
-  result->feature = new ValueType[n];
+void Tuple::Gather(const int *features, size_t n, ValueType *out) const {
+  if (feature) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = feature[features[i]];
+    }
+    return;
+  }
+
+  // merge the two sorted lists
+  size_t j = 0;
   for (size_t i = 0; i < n; ++i) {
-    result->feature[i] = kUnknownValue;
+    while (j < known.size() && known[j].first < features[i]) {
+      ++j;
+    }
+    out[i] = j < known.size() && known[j].first == features[i]? known[j].second : kUnknownValue;
   }
+}
 
-  std::vector<std::string> tokens;
-  if (SplitString(l, kItemDelimiter, &tokens) < (load_initial_guess? 3:2)) {
-    delete result;
-    return NULL;
+namespace {
+bool IndexLess(const std::pair<int, ValueType> &a, const std::pair<int, ValueType> &b) {
+  return a.first < b.first;
+}
+
+// powers of ten which are exact doubles
+const double kExactPowers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// `strtod' on a copy of the token at `begin', which may not be
+// terminated
+const char *ParseValueSlow(const char *begin, const char *end, double *value) {
+  const char *stop = begin;
+  while (stop < end && *stop != ' ' && *stop != '\n') {
+    ++stop;
+  }
+  std::string token(begin, stop);
+  char *token_end = NULL;
+  *value = std::strtod(token.c_str(), &token_end);
+  return begin + (token_end - token.c_str());
+}
+
+const char *ParseIndex(const char *begin, const char *end, size_t *index) {
+  const char *p = begin;
+  size_t r = 0;
+  while (p < end && IsDigit(*p)) {
+    r = r * 10 + (*p - '0');
+    ++p;
+  }
+  *index = r;
+  return p;
+}
+}
+
+const char *ParseValue(const char *begin, const char *end, double *value) {
+  // Numbers with at most 19 significant digits, whose mantissa and
+  // power of ten are exact doubles, are one correctly rounded
+  // multiplication or division away (Clinger's fast path). Everything
+  // else, e.g. `inf' or long mantissas, goes to `strtod'.
+  const char *p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  while (p < end && IsDigit(*p)) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa > 0) ++digits;
+    } else {
+      return ParseValueSlow(begin, end, value);
+    }
+    any = true;
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && IsDigit(*p)) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa > 0) ++digits;
+        --exponent;
+      } else {
+        return ParseValueSlow(begin, end, value);
+      }
+      any = true;
+      ++p;
+    }
+  }
+  if (!any || (p < end && (*p == 'x' || *p == 'X'))) {
+    // e.g. `nan', `inf' or hexadecimal
+    return ParseValueSlow(begin, end, value);
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negative_exponent = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negative_exponent = *q == '-';
+      ++q;
+    }
+    if (q < end && IsDigit(*q)) {
+      int e = 0;
+      while (q < end && IsDigit(*q)) {
+        if (e < 10000) e = e * 10 + (*q - '0');
+        ++q;
+      }
+      exponent += negative_exponent? -e : e;
+      p = q;
+    }
+  }
+
+  const uint64_t kMaxExactMantissa = 1ULL << 53;
+  if (mantissa > kMaxExactMantissa || exponent < -22 || exponent > 22) {
+    return ParseValueSlow(begin, end, value);
+  }
+  double r = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    r /= kExactPowers[-exponent];
+  } else {
+    r *= kExactPowers[exponent];
+  }
+  *value = negative? -r : r;
+  return p;
+}
+
+bool ParseLine(const std::string &l,
+               int number_of_feature,
+               bool two_class_classification,
+               bool load_initial_guess,
+               ValueType *initial_guess,
+               ValueType *label,
+               ValueType *weight,
+               SparseFeatures *features) {
+  return ParseLine(l.data(), l.data() + l.size(),
+                   number_of_feature,
+                   two_class_classification,
+                   load_initial_guess,
+                   initial_guess, label, weight, features);
+}
+
+bool ParseLine(const char *begin,
+               const char *end,
+               int number_of_feature,
+               bool two_class_classification,
+               bool load_initial_guess,
+               ValueType *initial_guess,
+               ValueType *label,
+               ValueType *weight,
+               SparseFeatures *features) {
+  // tokens are separated by `kItemDelimiter', numbers are parsed from
+  // the start of a token and the rest of it is ignored
+  const char delimiter = kItemDelimiter[0];
+  const char kv_delimiter = kKVDelimiter[0];
+
+  int head = load_initial_guess? 3 : 2;
+  double head_values[3];
+  const char *p = begin;
+  for (int i = 0; i < head; ++i) {
+    if (p >= end) {
+      return false;
+    }
+    ParseValue(p, end, &head_values[i]);
+    const char *next = static_cast<const char *>(std::memchr(p, delimiter, end - p));
+    p = next? next + 1 : end;
+    if (!next && i + 1 < head) {
+      return false;
+    }
   }
 
   size_t cur = 0;
   if (load_initial_guess) {
-    result->initial_guess = std::stod(tokens[cur++]);
+    *initial_guess = head_values[cur++];
   }
-  result->label = std::stod(tokens[cur++]);
-  result->weight = std::stod(tokens[cur++]);
+  *label = head_values[cur++];
+  *weight = head_values[cur++];
 
   // for two-class classifier, labels should be 1 or -1
   if (two_class_classification) {
-    result->label = result->label > 0? 1 : -1;
+    *label = *label > 0? 1 : -1;
   }
 
-  for (size_t i = cur; i < tokens.size(); ++i) {
-    size_t found = tokens[i].find(kKVDelimiter);
-    if (found == std::string::npos) {
-      std::cerr << "feature value pair with wrong format: " << tokens[i];
+  size_t n = number_of_feature;
+  while (p < end) {
+    const char *next = static_cast<const char *>(std::memchr(p, delimiter, end - p));
+    const char *token_end = next? next : end;
+    if (token_end == p) {
+      // repeated delimiter
+      ++p;
       continue;
     }
-    size_t index = std::stoi(tokens[i].substr(0, found));
-    if (index >= n) {
-      std::cerr << "feature index out of boundary: " << index;
-      continue;
+
+    const char *found = static_cast<const char *>(std::memchr(p, kv_delimiter, token_end - p));
+    size_t index = 0;
+    if (!found || ParseIndex(p, found, &index) == p) {
+      std::cerr << "feature value pair with wrong format: " << std::string(p, token_end);
+    } else {
+      if (index >= n) {
+        std::cerr << "feature index out of boundary: " << index;
+      } else {
+        double value = 0;
+        ParseValue(found + 1, token_end, &value);
+        features->push_back(std::make_pair(static_cast<int>(index),
+                                           static_cast<ValueType>(value)));
+      }
+    }
+    p = token_end + 1;
+  }
+
+  return true;
+}
+
+Tuple* Tuple::FromString(const std::string &l,
+                         int number_of_feature,
+                         bool two_class_classification,
+                         bool load_initial_guess,
+                         bool sparse) {
+  Tuple* result = new Tuple();
+  SparseFeatures features;
+  if (!ParseLine(l, number_of_feature,
+                 two_class_classification,
+                 load_initial_guess,
+                 &result->initial_guess,
+                 &result->label,
+                 &result->weight,
+                 &features)) {
+    delete result;
+    return NULL;
+  }
+
+  if (sparse) {
+    // sorted by index, the last value of an index wins as in dense tuples
+    std::stable_sort(features.begin(), features.end(), IndexLess);
+    SparseFeatures &known = result->known;
+    for (size_t i = 0; i < features.size(); ++i) {
+      if (!known.empty() && known.back().first == features[i].first) {
+        known.back().second = features[i].second;
+      } else {
+        known.push_back(features[i]);
+      }
     }
-    ValueType value = std::stod(tokens[i].substr(found+1));
-    result->feature[index] = value;
+    SparseFeatures(known).swap(known);
+    return result;
+  }
+
+  size_t n = number_of_feature;
+  result->feature = new ValueType[n];
+  for (size_t i = 0; i < n; ++i) {
+    result->feature[i] = kUnknownValue;
+  }
+  for (size_t i = 0; i < features.size(); ++i) {
+    result->feature[features[i].first] = features[i].second;
   }
 
   return result;
@@ -94,7 +321,8 @@ bool LoadDataFromFile(const std::string &path,
                       int number_of_feature,
                       bool two_class_classification,
                       bool load_initial_guess,
-                      bool ignore_weight) {
+                      bool ignore_weight,
+                      bool sparse) {
   data->clear();
   std::ifstream stream(path.c_str());
   if (!stream) {
@@ -106,11 +334,18 @@ bool LoadDataFromFile(const std::string &path,
   stream.rdbuf()->pubsetbuf(local_buffer, buffer_size);
 
   std::string l;
+  size_t line = 0;
   while(std::getline(stream, l)) {
+    ++line;
     Tuple *t = Tuple::FromString(l,
                                  number_of_feature,
                                  two_class_classification,
-                                 load_initial_guess);
+                                 load_initial_guess,
+                                 sparse);
+    if (!t) {
+      std::cerr << "invalid line " << line << " skipped: " << l << std::endl;
+      continue;
+    }
     if (ignore_weight) {
       t->weight = 1;
     }
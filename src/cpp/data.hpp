@@ -2,8 +2,11 @@
 
 #ifndef _DATA_H_
 #define _DATA_H_
+#include <algorithm>
 #include <limits>
 #include <string>
+#include <stdint.h>
+#include <utility>
 #include <vector>
 #include "util.hpp"
 
@@ -14,6 +17,38 @@ const ValueType kValueTypeMax = std::numeric_limits<ValueType>::max();
 const ValueType kValueTypeMin = std::numeric_limits<ValueType>::min();
 const ValueType kUnknownValue = kValueTypeMin;
 
+// bin index of a quantized feature value, see `BinMapper'
+typedef uint16_t BinType;
+
+// (index, value) pairs of known features
+typedef std::vector<std::pair<int, ValueType> > SparseFeatures;
+
+// Parse a line of data, see README for the format. Known features
+// are appended to `features'.
+bool ParseLine(const std::string &l,
+               int number_of_feature,
+               bool two_class_classification,
+               bool load_initial_guess,
+               ValueType *initial_guess,
+               ValueType *label,
+               ValueType *weight,
+               SparseFeatures *features);
+// Parse the line `[begin, end)' in place.
+bool ParseLine(const char *begin,
+               const char *end,
+               int number_of_feature,
+               bool two_class_classification,
+               bool load_initial_guess,
+               ValueType *initial_guess,
+               ValueType *label,
+               ValueType *weight,
+               SparseFeatures *features);
+
+// Parse the number at the start of `[begin, end)' to the same value as
+// `std::strtod', without allocating. Return the end of the number, or
+// `begin' if there is none.
+const char *ParseValue(const char *begin, const char *end, double *value);
+
 // enum VariableType {
 //   CONTINUOUS,
 //   ORDINAL,
@@ -34,16 +69,35 @@ class Tuple {
     delete[] feature;
   }
 
+  // If `sparse' is set, only known features are kept in `known' and
+  // `feature' is NULL, so that the tuple takes memory in proportion to
+  // its known features instead of `number_of_feature'.
   static Tuple* FromString(const std::string &l,
                            int number_of_feature,
                            bool two_class_classification,
-                           bool load_initial_guess=false);
+                           bool load_initial_guess=false,
+                           bool sparse=false);
 
   std::string ToString(int number_of_feature,
                        bool output_initial_guess=false) const;
 
+  // Value of feature `f', `kUnknownValue' if it is not known.
+  ValueType Get(int f) const {
+    if (feature) {
+      return feature[f];
+    }
+    SparseFeatures::const_iterator iter =
+        std::lower_bound(known.begin(), known.end(),
+                         std::make_pair(f, -kValueTypeMax));
+    return iter != known.end() && iter->first == f? iter->second : kUnknownValue;
+  }
+
+  // Store the values of the sorted features `features[0, n)' in `out'.
+  void Gather(const int *features, size_t n, ValueType *out) const;
+
  public:
-  ValueType *feature;
+  ValueType *feature;             // values of all features, NULL for a sparse tuple
+  SparseFeatures known;           // known features of a sparse tuple, sorted by index
   ValueType label;
   ValueType target;
   ValueType weight;
@@ -62,7 +116,8 @@ bool LoadDataFromFile(const std::string &path,
                       int number_of_feature,
                       bool two_class_classification,
                       bool load_initial_guess=false,
-                      bool ignore_weight=false);
+                      bool ignore_weight=false,
+                      bool sparse=false);
 
 typedef std::vector<ValueType> PredictVector;
 }
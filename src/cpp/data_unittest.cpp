@@ -1,9 +1,25 @@
 #include "data.hpp"
+#include "dataset.hpp"
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 using namespace gbdt;
 
+// Whether `bytes' written to a file load as binary data.
+static bool LoadBytes(const std::string &bytes) {
+  {
+    std::ofstream out("data_unittest.bin", std::ios::binary);
+    out << bytes;
+  }
+  Dataset d;
+  return d.LoadBinary("data_unittest.bin");
+}
+
 int main(int argc, char *argv[]) {
   UNUSED(argc);
   UNUSED(argv);
@@ -17,17 +33,162 @@ int main(int argc, char *argv[]) {
 
   std::cout << t->ToString(number_of_feature) << std::endl;
 
+  // a sparse tuple keeps known features only, in index order
+  Tuple *s = Tuple::FromString("0 2 2:5 0:10 2:7",
+                               number_of_feature,
+                               two_class_classification,
+                               false,
+                               true);
+  assert(s->feature == NULL && s->known.size() == 2);
+  assert(s->Get(0) == 10 && s->Get(1) == kUnknownValue && s->Get(2) == 7);
+  int features[] = {0, 1, 2};
+  ValueType values[3];
+  s->Gather(features, 3, values);
+  assert(values[0] == 10 && values[1] == kUnknownValue && values[2] == 7);
+  Tuple *dense = Tuple::FromString("0 2 0:10 2:7",
+                                   number_of_feature,
+                                   two_class_classification);
+  assert(s->ToString(number_of_feature) == dense->ToString(number_of_feature));
+  delete dense;
+  delete s;
+
+  // numbers are parsed to the same values as `strtod'
+  const char *numbers[] = {"0", "-0", "1", "-2.5", "0.1", "3.14159265358979323846",
+                           "1e10", "1.5E-7", "-1e-30", "1e400", "123456789012345678901",
+                           "0.000000000000000000001", "9007199254740993", "nan",
+                           "-inf", "0x10", "2.", ".5", "7e", "+3"};
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i) {
+    const char *s = numbers[i];
+    double v = 0;
+    const char *stop = ParseValue(s, s + std::strlen(s), &v);
+    char *expected_stop = NULL;
+    double expected = std::strtod(s, &expected_stop);
+    assert(stop == expected_stop);
+    assert(std::memcmp(&v, &expected, sizeof(v)) == 0 || (v != v && expected != expected));
+  }
+  std::srand(0);
+  for (int i = 0; i < 100000; ++i) {
+    char s[64];
+    double x = (std::rand() - RAND_MAX / 2.0) / (1 + std::rand() % 100000);
+    std::snprintf(s, sizeof(s), (i % 2)? "%.17g" : "%f", x);
+    double v = 0;
+    ParseValue(s, s + std::strlen(s), &v);
+    assert(v == std::strtod(s, NULL));
+  }
+
   DataVector d;
   bool r = LoadDataFromFile("../../data/test.txt",
                             &d,
                             number_of_feature,
                             two_class_classification);
   assert(r);
+
+  // the parallel loader reads the same rows
+  Dataset data;
+  r = LoadDataFromFile("../../data/test.txt",
+                       &data,
+                       number_of_feature,
+                       two_class_classification);
+  assert(r);
+  assert(data.Size() == d.size());
+  for (size_t i = 0; i < d.size(); ++i) {
+    assert(data.label[i] == d[i]->label);
+    assert(data.weight[i] == d[i]->weight);
+    for (int f = 0; f < number_of_feature; ++f) {
+      assert(data.GetValue(f, i) == d[i]->feature[f]);
+    }
+  }
+
+  // binary data reads back the same, raw or binned
+  for (int binned = 0; binned < 2; ++binned) {
+    if (binned) {
+      data.Quantize(4);
+    }
+    r = data.SaveBinary("data_unittest.bin");
+    assert(r);
+    Dataset copy;
+    r = copy.LoadBinary("data_unittest.bin");
+    assert(r);
+    assert(copy.Size() == data.Size() && copy.IsQuantized() == data.IsQuantized());
+    assert(copy.TwoClassLabels() && data.TwoClassLabels());
+    for (size_t i = 0; i < data.Size(); ++i) {
+      assert(copy.label[i] == data.label[i]);
+      assert(copy.weight[i] == data.weight[i]);
+      assert(copy.initial_guess[i] == data.initial_guess[i]);
+      for (int f = 0; f < number_of_feature; ++f) {
+        assert(copy.GetValue(f, i) == data.GetValue(f, i));
+      }
+    }
+  }
+
+  // binned data is rejected with a code out of its bin column, or with
+  // a feature twice in the order of bin columns
+  {
+    std::ifstream in("data_unittest.bin", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    assert(data.BinWidth() == 1 && LoadBytes(bytes));
+
+    size_t padding = (8 - data.Size() % 8) % 8;
+    std::string bad_code = bytes;
+    bad_code[bytes.size() - padding - 1] = static_cast<char>(255);
+    assert(!LoadBytes(bad_code));
+
+    // header, labels, weights, initial guesses, bound counts and bounds
+    size_t total_bounds = 0;
+    for (int f = 0; f < number_of_feature; ++f) {
+      total_bounds += data.GetBinMapper().Bounds(f).size();
+    }
+    size_t order = 40 + (3 * data.Size() + number_of_feature + total_bounds) * 8;
+    std::string bad_order = bytes;
+    std::memcpy(&bad_order[order + sizeof(int)], &bytes[order], sizeof(int));
+    assert(bad_order != bytes);
+    assert(!LoadBytes(bad_order));
+  }
+  std::remove("data_unittest.bin");
+  assert(!data.LoadBinary("../../data/test.txt"));
+
+  // both loaders skip the same invalid lines
+  {
+    std::ofstream out("data_unittest.txt");
+    out << "1 1 0:1\n\n7\n-1 2 1:3\n";
+  }
+  DataVector rows;
+  r = LoadDataFromFile("data_unittest.txt", &rows, number_of_feature,
+                       two_class_classification);
+  assert(r && rows.size() == 2);
+  Dataset columns;
+  r = LoadDataFromFile("data_unittest.txt", &columns, number_of_feature,
+                       two_class_classification);
+  assert(r && columns.Size() == 2);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    assert(columns.label[i] == rows[i]->label && columns.weight[i] == rows[i]->weight);
+  }
+  CleanDataVector(&rows);
+  std::remove("data_unittest.txt");
+
   DataVector::iterator iter = d.begin();
   for ( ; iter != d.end(); ++iter) {
     std::cout << (*iter)->ToString(number_of_feature) << std::endl;
   }
 
+  DataVector sparse;
+  r = LoadDataFromFile("../../data/test.txt",
+                       &sparse,
+                       number_of_feature,
+                       two_class_classification,
+                       false,
+                       false,
+                       true);
+  assert(r && sparse.size() == d.size());
+  for (size_t i = 0; i < d.size(); ++i) {
+    for (int f = 0; f < number_of_feature; ++f) {
+      assert(sparse[i]->Get(f) == d[i]->feature[f]);
+    }
+  }
+
+  CleanDataVector(&sparse);
   CleanDataVector(&d);
+  delete t;
   return 0;
 }
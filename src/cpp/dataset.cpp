@@ -0,0 +1,624 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "dataset.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// features by decreasing number of known values, dense ones first
+struct FeatureDenser {
+  FeatureDenser(const std::vector<std::vector<size_t> > &known,
+                const std::vector<char> &sparse):
+      known(known), sparse(sparse) {}
+
+  bool operator () (int f1, int f2) const {
+    if (sparse[f1] != sparse[f2]) return sparse[f2];
+    return known[f1].size() > known[f2].size();
+  }
+
+  const std::vector<std::vector<size_t> > &known;
+  const std::vector<char> &sparse;
+};
+
+struct BinaryDatasetHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t value_size;         // sizeof(ValueType)
+  uint32_t number_of_feature;
+  uint64_t size;
+  uint32_t bin_width;          // 0 for raw values
+  uint32_t number_of_columns;  // bin columns
+  uint32_t two_class;          // `Dataset::TwoClassLabels'
+};
+
+const char kBinaryDatasetMagic[4] = {'G', 'B', 'D', 'D'};
+const uint32_t kBinaryDatasetVersion = 2;
+const size_t kSectionAlignment = 8;
+
+// Every section starts at a multiple of `kSectionAlignment', so that
+// arrays of a mapped file are aligned.
+template <typename T>
+void WriteSection(std::ofstream *out, const T *a, size_t n) {
+  static const char kPadding[kSectionAlignment] = {0};
+  size_t bytes = n * sizeof(T);
+  if (bytes > 0) {
+    out->write(reinterpret_cast<const char *>(a), bytes);
+  }
+  out->write(kPadding, (kSectionAlignment - bytes % kSectionAlignment) % kSectionAlignment);
+}
+
+class SectionReader {
+ public:
+  SectionReader(const char *data, size_t size, size_t offset):
+      data(data), size(size), offset(offset) {}
+
+  template <typename T>
+  bool Read(size_t n, std::vector<T> *out) {
+    if (n > (size - offset) / sizeof(T)) {
+      return false;
+    }
+    const T *begin = reinterpret_cast<const T *>(data + offset);
+    out->assign(begin, begin + n);
+    size_t bytes = n * sizeof(T);
+    offset += std::min(size - offset,
+                       (bytes + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment);
+    return true;
+  }
+
+ private:
+  const char *data;
+  size_t size;
+  size_t offset;
+};
+
+// Read `n' bin codes of a bin column of `column_bins' codes.
+template <typename T>
+bool ReadCodes(SectionReader *reader, size_t n, size_t column_bins, std::vector<T> *out) {
+  if (!reader->Read(n, out)) {
+    return false;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if ((*out)[i] >= column_bins) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+namespace gbdt {
+
+void Dataset::Reset(size_t n, int number_of_feature) {
+  size = n;
+  this->number_of_feature = number_of_feature;
+  bin_width = 0;
+  two_class = false;
+
+  label.assign(n, 0);
+  weight.assign(n, 0);
+  target.assign(n, 0);
+  residual.assign(n, 0);
+  hessian.assign(n, 0);
+  initial_guess.assign(n, kUnknownValue);
+
+  values.assign(number_of_feature, std::vector<ValueType>(n, kUnknownValue));
+  FreeVector(&bins8);
+  FreeVector(&bins16);
+  FreeVector(&columns);
+  FreeVector(&column_bins);
+}
+
+void Dataset::FromDataVector(const DataVector &d, size_t len, int number_of_feature) {
+  assert(d.size() >= len);
+  Reset(len, number_of_feature);
+
+  for (size_t i = 0; i < len; ++i) {
+    label[i] = d[i]->label;
+    weight[i] = d[i]->weight;
+    target[i] = d[i]->target;
+    residual[i] = d[i]->residual;
+    initial_guess[i] = d[i]->initial_guess;
+    if (!d[i]->feature) {
+      const SparseFeatures &known = d[i]->known;
+      for (size_t k = 0; k < known.size(); ++k) {
+        values[known[k].first][i] = known[k].second;
+      }
+    }
+  }
+
+  for (int f = 0; f < number_of_feature; ++f) {
+    ValueType *column = Column(f);
+    for (size_t i = 0; i < len; ++i) {
+      if (d[i]->feature) {
+        column[i] = d[i]->feature[f];
+      }
+    }
+  }
+}
+
+void Dataset::Quantize(int max_bins, bool bundle) {
+  assert(!IsQuantized());
+  mapper.Fit(*this, max_bins);
+  Encode(bundle);
+}
+
+void Dataset::Quantize(const BinMapper &m, bool bundle) {
+  assert(!IsQuantized() && m.NumberOfFeature() == number_of_feature);
+  mapper = m;
+  Encode(bundle);
+}
+
+void Dataset::Encode(bool bundle) {
+  size_t max_num_bins = 0;
+  for (int f = 0; f < number_of_feature; ++f) {
+    max_num_bins = std::max(max_num_bins, mapper.NumBins(f));
+  }
+
+  // Bundles may need two byte codes, which is only worth it if there
+  // are less than half as many bin columns as features.
+  size_t capacity = max_num_bins <= 256? 256 : 65536;
+  BundleFeatures(bundle, bundle? 65536 : capacity);
+  if (capacity == 256 && bundle) {
+    size_t max_column_bins = 0;
+    for (int g = 0; g < NumberOfBinColumns(); ++g) {
+      max_column_bins = std::max(max_column_bins, column_bins[g]);
+    }
+    if (max_column_bins > 256 && 2 * NumberOfBinColumns() >= number_of_feature) {
+      BundleFeatures(bundle, 256);
+    } else if (max_column_bins > 256) {
+      capacity = 65536;
+    }
+  }
+
+  int n = NumberOfBinColumns();
+  if (capacity == 256) {
+    bins8.assign(n, std::vector<uint8_t>());
+  } else {
+    bins16.assign(n, std::vector<uint16_t>());
+  }
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int g = 0; g < n; ++g) {
+    if (capacity == 256) {
+      bins8[g].assign(size, 0);
+    } else {
+      bins16[g].assign(size, 0);
+    }
+    for (size_t k = 0; k < columns[g].size(); ++k) {
+      int f = columns[g][k];
+      const ValueType *column = Column(f);
+      for (size_t i = 0; i < size; ++i) {
+        BinType b = mapper.ValueToBin(f, column[i]);
+        if (b == 0) {
+          continue;
+        }
+        if (capacity == 256) {
+          bins8[g][i] = static_cast<uint8_t>(bin_start[f] + b);
+        } else {
+          bins16[g][i] = static_cast<uint16_t>(bin_start[f] + b);
+        }
+      }
+      FreeVector(&values[f]);
+    }
+  }
+
+  FreeVector(&values);
+  bin_width = capacity == 256? 1 : 2;
+}
+
+void Dataset::BundleFeatures(bool bundle, size_t capacity) {
+  // Features with known values in at most this portion of rows are
+  // bundled. Every bundle remembers its rows with a known value, and a
+  // feature only tries the latest `kMaxTries' bundles.
+  const double kMaxDensity = 0.5;
+  const size_t kMaxTries = 64;
+
+  columns.clear();
+  column_bins.clear();
+  bin_column.assign(number_of_feature, 0);
+  bin_start.assign(number_of_feature, 0);
+  bin_count.assign(number_of_feature, 0);
+  for (int f = 0; f < number_of_feature; ++f) {
+    bin_count[f] = static_cast<int>(mapper.NumBins(f));
+  }
+
+  if (!bundle) {
+    for (int f = 0; f < number_of_feature; ++f) {
+      bin_column[f] = f;
+      columns.push_back(std::vector<int>(1, f));
+      column_bins.push_back(bin_count[f]);
+    }
+    return;
+  }
+
+  // rows with known values of each sparse feature
+  std::vector<std::vector<size_t> > known(number_of_feature);
+  std::vector<char> sparse(number_of_feature, 0);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int f = 0; f < number_of_feature; ++f) {
+    const ValueType *column = Column(f);
+    size_t nnz = 0;
+    for (size_t i = 0; i < size; ++i) {
+      nnz += column[i] != kUnknownValue;
+    }
+    if (static_cast<double>(nnz) > static_cast<double>(size) * kMaxDensity) {
+      continue;
+    }
+    sparse[f] = 1;
+    known[f].reserve(nnz);
+    for (size_t i = 0; i < size; ++i) {
+      if (column[i] != kUnknownValue) {
+        known[f].push_back(i);
+      }
+    }
+  }
+
+  // greedily, the densest features first
+  std::vector<int> order;
+  for (int f = 0; f < number_of_feature; ++f) {
+    order.push_back(f);
+  }
+  std::stable_sort(order.begin(), order.end(), FeatureDenser(known, sparse));
+
+  std::vector<int> open;    // bin columns of sparse features
+  std::vector<std::vector<uint64_t> > occupied;
+  for (size_t k = 0; k < order.size(); ++k) {
+    int f = order[k];
+    size_t nb = bin_count[f];
+    int g = -1;
+    if (sparse[f]) {
+      for (size_t t = 0; t < open.size() && t < kMaxTries && g < 0; ++t) {
+        int c = open[open.size() - 1 - t];
+        if (column_bins[c] + nb - 1 > capacity) {
+          continue;
+        }
+        const std::vector<uint64_t> &bits = occupied[c];
+        bool conflict = false;
+        for (size_t j = 0; j < known[f].size() && !conflict; ++j) {
+          size_t i = known[f][j];
+          conflict = (bits[i / 64] >> (i % 64)) & 1;
+        }
+        if (!conflict) {
+          g = c;
+        }
+      }
+    }
+
+    if (g < 0) {
+      g = NumberOfBinColumns();
+      columns.push_back(std::vector<int>());
+      column_bins.push_back(1);
+      occupied.push_back(std::vector<uint64_t>());
+      if (sparse[f]) {
+        occupied.back().assign((size + 63) / 64, 0);
+        open.push_back(g);
+      }
+    }
+
+    bin_column[f] = g;
+    bin_start[f] = static_cast<int>(column_bins[g]) - 1;
+    column_bins[g] += nb - 1;
+    columns[g].push_back(f);
+    if (sparse[f]) {
+      std::vector<uint64_t> &bits = occupied[g];
+      for (size_t j = 0; j < known[f].size(); ++j) {
+        size_t i = known[f][j];
+        bits[i / 64] |= static_cast<uint64_t>(1) << (i % 64);
+      }
+      FreeVector(&known[f]);
+    }
+  }
+}
+
+bool Dataset::SaveBinary(const std::string &path) const {
+  assert(IsLittleEndian());
+  std::ofstream out(path.c_str(), std::ios::binary);
+  if (!out) {
+    return false;
+  }
+
+  BinaryDatasetHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kBinaryDatasetMagic, sizeof(header.magic));
+  header.version = kBinaryDatasetVersion;
+  header.value_size = sizeof(ValueType);
+  header.number_of_feature = number_of_feature;
+  header.size = size;
+  header.bin_width = bin_width;
+  header.number_of_columns = static_cast<uint32_t>(columns.size());
+  header.two_class = two_class;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  WriteSection(&out, label.data(), size);
+  WriteSection(&out, weight.data(), size);
+  WriteSection(&out, initial_guess.data(), size);
+
+  if (bin_width == 0) {
+    for (int f = 0; f < number_of_feature; ++f) {
+      WriteSection(&out, values[f].data(), size);
+    }
+    return out.good();
+  }
+
+  // bin boundaries, then features of bin columns in order
+  std::vector<uint64_t> num_bounds;
+  std::vector<ValueType> bounds;
+  for (int f = 0; f < number_of_feature; ++f) {
+    const std::vector<ValueType> &b = mapper.Bounds(f);
+    num_bounds.push_back(b.size());
+    bounds.insert(bounds.end(), b.begin(), b.end());
+  }
+  std::vector<int> order;
+  for (size_t g = 0; g < columns.size(); ++g) {
+    order.insert(order.end(), columns[g].begin(), columns[g].end());
+  }
+  WriteSection(&out, num_bounds.data(), num_bounds.size());
+  WriteSection(&out, bounds.data(), bounds.size());
+  WriteSection(&out, order.data(), order.size());
+  WriteSection(&out, bin_column.data(), bin_column.size());
+  WriteSection(&out, bin_start.data(), bin_start.size());
+
+  for (size_t g = 0; g < columns.size(); ++g) {
+    if (bin_width == 1) {
+      WriteSection(&out, bins8[g].data(), size);
+    } else {
+      WriteSection(&out, bins16[g].data(), size);
+    }
+  }
+  return out.good();
+}
+
+bool Dataset::LoadBinary(const std::string &path) {
+  MappedFile file;
+  if (!IsLittleEndian() || !file.Open(path) || file.Size() < sizeof(BinaryDatasetHeader)) {
+    return false;
+  }
+
+  BinaryDatasetHeader header;
+  std::memcpy(&header, file.Data(), sizeof(header));
+  if (std::memcmp(header.magic, kBinaryDatasetMagic, sizeof(header.magic)) != 0 ||
+      header.version != kBinaryDatasetVersion ||
+      header.value_size != sizeof(ValueType) ||
+      (header.bin_width != 0 && header.bin_width != 1 && header.bin_width != 2)) {
+    return false;
+  }
+
+  size = header.size;
+  number_of_feature = header.number_of_feature;
+  bin_width = header.bin_width;
+  two_class = header.two_class != 0;
+  FreeVector(&values);
+  FreeVector(&bins8);
+  FreeVector(&bins16);
+  FreeVector(&columns);
+  FreeVector(&column_bins);
+
+  SectionReader reader(file.Data(), file.Size(), sizeof(header));
+  if (!reader.Read(size, &label) ||
+      !reader.Read(size, &weight) ||
+      !reader.Read(size, &initial_guess)) {
+    return false;
+  }
+  target.assign(size, 0);
+  residual.assign(size, 0);
+  hessian.assign(size, 0);
+
+  if (bin_width == 0) {
+    values.resize(number_of_feature);
+    for (int f = 0; f < number_of_feature; ++f) {
+      if (!reader.Read(size, &values[f])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<uint64_t> num_bounds;
+  std::vector<ValueType> all_bounds;
+  std::vector<int> order;
+  if (!reader.Read(number_of_feature, &num_bounds)) {
+    return false;
+  }
+  uint64_t total_bounds = 0;
+  for (int f = 0; f < number_of_feature; ++f) {
+    if (num_bounds[f] >= std::numeric_limits<BinType>::max()) {
+      return false;
+    }
+    total_bounds += num_bounds[f];
+  }
+  if (!reader.Read(total_bounds, &all_bounds) ||
+      !reader.Read(number_of_feature, &order) ||
+      !reader.Read(number_of_feature, &bin_column) ||
+      !reader.Read(number_of_feature, &bin_start)) {
+    return false;
+  }
+
+  std::vector<std::vector<ValueType> > bounds(number_of_feature);
+  std::vector<ValueType>::const_iterator next = all_bounds.begin();
+  for (int f = 0; f < number_of_feature; ++f) {
+    bounds[f].assign(next, next + num_bounds[f]);
+    next += num_bounds[f];
+  }
+  mapper.SetBounds(bounds);
+
+  int n = header.number_of_columns;
+  size_t capacity = bin_width == 1? 256 : 65536;
+  bin_count.assign(number_of_feature, 0);
+  columns.assign(n, std::vector<int>());
+  column_bins.assign(n, 1);
+  std::vector<char> seen(number_of_feature, 0);
+  for (int k = 0; k < number_of_feature; ++k) {
+    int f = order[k];
+    if (f < 0 || f >= number_of_feature || seen[f] ||
+        bin_column[f] < 0 || bin_column[f] >= n) {
+      return false;
+    }
+    seen[f] = 1;
+    int g = bin_column[f];
+    bin_count[f] = static_cast<int>(mapper.NumBins(f));
+    if (bin_start[f] != static_cast<int>(column_bins[g]) - 1 ||
+        column_bins[g] + bin_count[f] - 1 > capacity) {
+      return false;
+    }
+    columns[g].push_back(f);
+    column_bins[g] += bin_count[f] - 1;
+  }
+
+  if (bin_width == 1) {
+    bins8.resize(n);
+  } else {
+    bins16.resize(n);
+  }
+  for (int g = 0; g < n; ++g) {
+    if (!(bin_width == 1? ReadCodes(&reader, size, column_bins[g], &bins8[g])
+                        : ReadCodes(&reader, size, column_bins[g], &bins16[g]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace {
+// Rows parsed from a chunk of a data file, in sparse form, as columns
+// can only be allocated once the number of rows is known.
+struct ParsedChunk {
+  std::vector<ValueType> label;
+  std::vector<ValueType> weight;
+  std::vector<ValueType> initial_guess;
+  std::vector<size_t> row_end;
+  SparseFeatures features;
+  size_t lines;
+  // (line in the chunk, text) of the lines `ParseLine' rejects
+  std::vector<std::pair<size_t, std::string> > skipped;
+};
+
+// chunks are at least this large, so that small files are not split
+const size_t kMinChunkSize = 4 * 1024 * 1024;
+
+void ParseChunk(const char *begin, const char *end,
+                int number_of_feature,
+                bool two_class_classification,
+                bool load_initial_guess,
+                bool ignore_weight,
+                ParsedChunk *chunk) {
+  const char *p = begin;
+  chunk->lines = 0;
+  while (p < end) {
+    ++chunk->lines;
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (!eol) {
+      eol = end;
+    }
+
+    ValueType g = kUnknownValue, y = 0, w = 0;
+    size_t start = chunk->features.size();
+    if (ParseLine(p, eol, number_of_feature,
+                  two_class_classification,
+                  load_initial_guess,
+                  &g, &y, &w, &chunk->features)) {
+      chunk->label.push_back(y);
+      chunk->weight.push_back(ignore_weight? 1 : w);
+      chunk->initial_guess.push_back(g);
+      chunk->row_end.push_back(chunk->features.size());
+    } else {
+      chunk->features.resize(start);
+      chunk->skipped.push_back(std::make_pair(chunk->lines, std::string(p, eol)));
+    }
+    p = eol + 1;
+  }
+}
+}
+
+bool LoadDataFromFile(const std::string &path,
+                      Dataset *data,
+                      int number_of_feature,
+                      bool two_class_classification,
+                      bool load_initial_guess,
+                      bool ignore_weight) {
+  MappedFile file;
+  if (!file.Open(path)) {
+    return false;
+  }
+  const char *begin = file.Data();
+  const char *end = begin + file.Size();
+
+  // split the file into chunks at line boundaries, parsed in parallel
+  int threads = 1;
+#ifdef USE_OPENMP
+  threads = omp_get_max_threads();
+#endif
+  size_t n_chunks = std::min<size_t>(4 * threads, file.Size() / kMinChunkSize + 1);
+  std::vector<const char *> bounds(1, begin);
+  for (size_t k = 1; k < n_chunks; ++k) {
+    const char *p = std::max(begin + file.Size() / n_chunks * k, bounds.back());
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    bounds.push_back(eol? eol + 1 : end);
+  }
+  bounds.push_back(end);
+
+  std::vector<ParsedChunk> chunks(n_chunks);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t k = 0; k < n_chunks; ++k) {
+    ParseChunk(bounds[k], bounds[k+1], number_of_feature,
+               two_class_classification, load_initial_guess, ignore_weight,
+               &chunks[k]);
+  }
+
+  // invalid lines are reported as by the loader of `DataVector'
+  std::vector<size_t> first_row(n_chunks + 1, 0);
+  size_t line = 0;
+  for (size_t k = 0; k < n_chunks; ++k) {
+    first_row[k+1] = first_row[k] + chunks[k].label.size();
+    for (size_t i = 0; i < chunks[k].skipped.size(); ++i) {
+      std::cerr << "invalid line " << line + chunks[k].skipped[i].first
+                << " skipped: " << chunks[k].skipped[i].second << std::endl;
+    }
+    line += chunks[k].lines;
+  }
+
+  data->Reset(first_row[n_chunks], number_of_feature);
+  data->SetTwoClassLabels(two_class_classification);
+
+  // chunks fill disjoint rows of the columns
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t k = 0; k < n_chunks; ++k) {
+    ParsedChunk &chunk = chunks[k];
+    size_t offset = first_row[k];
+    std::copy(chunk.label.begin(), chunk.label.end(), data->label.begin() + offset);
+    std::copy(chunk.weight.begin(), chunk.weight.end(), data->weight.begin() + offset);
+    std::copy(chunk.initial_guess.begin(), chunk.initial_guess.end(),
+              data->initial_guess.begin() + offset);
+
+    size_t j = 0;
+    for (size_t i = 0; i < chunk.row_end.size(); ++i) {
+      for (; j < chunk.row_end[i]; ++j) {
+        data->Column(chunk.features[j].first)[offset + i] = chunk.features[j].second;
+      }
+    }
+    // release the chunk early, the sparse rows take more memory than
+    // the columns
+    FreeVector(&chunk.features);
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,131 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _DATASET_H_
+#define _DATASET_H_
+#include <vector>
+#include "data.hpp"
+#include "histogram.hpp"
+
+namespace gbdt {
+
+// Column-major training data. Values of each feature are kept in one
+// contiguous array, and so are labels, weights, targets and
+// residuals, so that scanning a feature or computing gradients walks
+// memory sequentially instead of chasing one `Tuple' per row.
+//
+// After `Quantize', raw feature values are dropped and features are
+// stored as bin codes of one byte (up to 256 bins) or two bytes, in bin
+// columns. A bin column holds one feature, or with feature bundling
+// several mutually exclusive ones: no row has known values of two of
+// them, so code 0 stands for all of them unknown and every feature
+// owns a range of the other codes.
+class Dataset {
+ public:
+  Dataset(): size(0), number_of_feature(0), bin_width(0), two_class(false) {}
+
+  // Allocate `n' rows, all features unknown.
+  void Reset(size_t n, int number_of_feature);
+  // Copy the first `len' tuples of `d'.
+  void FromDataVector(const DataVector &d, size_t len, int number_of_feature);
+
+  // Write labels, weights, initial guesses and features, raw or
+  // quantized with their bin boundaries, to a binary file, which
+  // `LoadBinary' reads back without parsing or binning again.
+  bool SaveBinary(const std::string &path) const;
+  bool LoadBinary(const std::string &path);
+
+  size_t Size() const { return size; }
+  int NumberOfFeature() const { return number_of_feature; }
+  // Whether the labels are the ones of two-class classification, as
+  // parsed by `LoadDataFromFile'; kept in binary files.
+  bool TwoClassLabels() const { return two_class; }
+  void SetTwoClassLabels(bool b) { two_class = b; }
+
+  // Raw values of feature `f', only available before quantization.
+  ValueType *Column(int f) { return &values[f][0]; }
+  const ValueType *Column(int f) const { return &values[f][0]; }
+
+  // Discretize all features into at most `max_bins' bins each and
+  // release the raw values. If `bundle' is set, mutually exclusive
+  // features share bin columns, so that sparse data takes memory and
+  // histogram building time in proportion to its known values.
+  void Quantize(int max_bins, bool bundle=false);
+  // Discretize with the bins of `mapper', e.g. saved with a model.
+  void Quantize(const BinMapper &mapper, bool bundle=false);
+  bool IsQuantized() const { return bin_width > 0; }
+  // size of a bin code in bytes
+  int BinWidth() const { return bin_width; }
+  const BinMapper &GetBinMapper() const { return mapper; }
+
+  int NumberOfBinColumns() const { return static_cast<int>(columns.size()); }
+  // features stored in bin column `g'
+  const std::vector<int> &ColumnFeatures(int g) const { return columns[g]; }
+  // number of codes of bin column `g'
+  size_t ColumnBins(int g) const { return column_bins[g]; }
+  // Bin `b > 0' of feature `f' is stored as code `BinStart(f) + b' of
+  // bin column `ColumnOf(f)'.
+  int BinStart(int f) const { return bin_start[f]; }
+  int ColumnOf(int f) const { return bin_column[f]; }
+
+  const uint8_t *BinColumn8(int g) const { return &bins8[g][0]; }
+  const uint16_t *BinColumn16(int g) const { return &bins16[g][0]; }
+
+  BinType GetBin(int f, size_t i) const {
+    int g = bin_column[f];
+    int b = (bin_width == 1? bins8[g][i] : bins16[g][i]) - bin_start[f];
+    return b > 0 && b < bin_count[f]? static_cast<BinType>(b) : 0;
+  }
+
+  // Value of feature `f' at row `i'. For quantized data, a value in
+  // the same bin is returned, which is routed the same way by any split
+  // found on this data.
+  ValueType GetValue(int f, size_t i) const {
+    if (bin_width == 0) {
+      return values[f][i];
+    }
+    return mapper.BinToValue(f, GetBin(f, i));
+  }
+
+ public:
+  std::vector<ValueType> label;
+  std::vector<ValueType> weight;
+  std::vector<ValueType> target;
+  std::vector<ValueType> residual;
+  std::vector<ValueType> hessian;      // set by second-order objectives
+  std::vector<ValueType> initial_guess;
+
+ private:
+  // Store the bin codes of `mapper' in bin columns.
+  void Encode(bool bundle);
+  // Assign features to bin columns, at most `capacity' codes each.
+  void BundleFeatures(bool bundle, size_t capacity);
+
+  size_t size;
+  int number_of_feature;
+  int bin_width;
+  bool two_class;
+
+  std::vector<std::vector<ValueType> > values;
+  std::vector<std::vector<uint8_t> > bins8;
+  std::vector<std::vector<uint16_t> > bins16;
+  BinMapper mapper;
+
+  std::vector<std::vector<int> > columns;
+  std::vector<size_t> column_bins;
+  std::vector<int> bin_column;    // bin column of each feature
+  std::vector<int> bin_start;
+  std::vector<int> bin_count;     // `BinMapper::NumBins' of each feature
+
+  DISALLOW_COPY_AND_ASSIGN(Dataset);
+};
+
+bool LoadDataFromFile(const std::string &path,
+                      Dataset *data,
+                      int number_of_feature,
+                      bool two_class_classification,
+                      bool load_initial_guess=false,
+                      bool ignore_weight=false);
+
+}
+
+#endif /* _DATASET_H_ */
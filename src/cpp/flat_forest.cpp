@@ -0,0 +1,372 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "flat_forest.hpp"
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FLAT_FOREST_SIMD
+#include <immintrin.h>
+#endif
+
+namespace gbdt {
+
+namespace {
+// node arrays of a forest, as seen by the traversal kernels
+struct Nodes {
+  const int *feature;
+  const ValueType *threshold;
+  const int *first_child;
+};
+
+// Store in `leaf' the leaf reached from `root' by each of the `n' rows
+// of `x'.
+typedef void (*TraverseFunc)(const Nodes &t, int root,
+                             const ValueType *x, int nf, int n, int *leaf);
+
+void TraverseScalar(const Nodes &t, int root,
+                    const ValueType *x, int nf, int n, int *leaf) {
+  for (int j = 0; j < n; ++j) {
+    const ValueType *row = x + j * nf;
+    int node = root;
+    while (t.feature[node] >= 0) {
+      ValueType v = row[t.feature[node]];
+      if (v == kUnknownValue) {
+        node = t.first_child[node] + Node::UNKNOWN;
+      } else if (v < t.threshold[node]) {
+        node = t.first_child[node] + Node::LT;
+      } else {
+        node = t.first_child[node] + Node::GE;
+      }
+    }
+    leaf[j] = node;
+  }
+}
+
+#ifdef FLAT_FOREST_SIMD
+// The kernels below move a group of rows one level down per step: the
+// split feature, threshold and children of each row's node are gathered,
+// the row's value is gathered and compared, and the child is picked with
+// a blend. Rows which reached a leaf stay there until the whole group is
+// done. `v < threshold' is computed as not(v >= threshold), so a NaN goes
+// to GE as in the scalar code.
+
+// Pack two masks of 4 doubles into one mask of 8 ints.
+__attribute__((target("avx2")))
+inline __m256i NarrowMask(__m256d lo, __m256d hi) {
+  __m256 m = _mm256_shuffle_ps(_mm256_castpd_ps(lo), _mm256_castpd_ps(hi),
+                               _MM_SHUFFLE(2, 0, 2, 0));
+  return _mm256_permute4x64_epi64(_mm256_castps_si256(m),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+__attribute__((target("avx2")))
+void TraverseAVX2(const Nodes &t, int root,
+                  const ValueType *x, int nf, int n, int *leaf) {
+  const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                           _mm256_set1_epi32(nf));
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i lt = _mm256_set1_epi32(Node::LT);
+  const __m256i ge = _mm256_set1_epi32(Node::GE);
+  const __m256i unknown = _mm256_set1_epi32(Node::UNKNOWN);
+  const __m256d unknown_value = _mm256_set1_pd(kUnknownValue);
+  // gathers are masked with all lanes on, from a defined source
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256d zero_pd = _mm256_setzero_pd();
+  const __m256d all_pd = _mm256_castsi256_pd(minus_one);
+
+  int j = 0;
+  for (; j + 8 <= n; j += 8) {
+    const ValueType *base = x + j * nf;
+    __m256i node = _mm256_set1_epi32(root);
+    for (;;) {
+      __m256i f = _mm256_mask_i32gather_epi32(zero, t.feature, node, minus_one, 4);
+      __m256i active = _mm256_cmpgt_epi32(f, minus_one);
+      if (_mm256_testz_si256(active, active)) {
+        break;
+      }
+      // leaves read the first feature of the row, which is not used
+      __m256i index = _mm256_add_epi32(lanes, _mm256_and_si256(f, active));
+      __m128i index_lo = _mm256_castsi256_si128(index);
+      __m128i index_hi = _mm256_extracti128_si256(index, 1);
+      __m128i node_lo = _mm256_castsi256_si128(node);
+      __m128i node_hi = _mm256_extracti128_si256(node, 1);
+
+      __m256d v_lo = _mm256_mask_i32gather_pd(zero_pd, base, index_lo, all_pd, 8);
+      __m256d v_hi = _mm256_mask_i32gather_pd(zero_pd, base, index_hi, all_pd, 8);
+      __m256d t_lo = _mm256_mask_i32gather_pd(zero_pd, t.threshold, node_lo, all_pd, 8);
+      __m256d t_hi = _mm256_mask_i32gather_pd(zero_pd, t.threshold, node_hi, all_pd, 8);
+
+      __m256i is_ge = NarrowMask(_mm256_cmp_pd(v_lo, t_lo, _CMP_NLT_UQ),
+                                 _mm256_cmp_pd(v_hi, t_hi, _CMP_NLT_UQ));
+      __m256i is_unknown = NarrowMask(_mm256_cmp_pd(v_lo, unknown_value, _CMP_EQ_OQ),
+                                      _mm256_cmp_pd(v_hi, unknown_value, _CMP_EQ_OQ));
+      __m256i child = _mm256_blendv_epi8(lt, ge, is_ge);
+      child = _mm256_blendv_epi8(child, unknown, is_unknown);
+
+      __m256i first = _mm256_mask_i32gather_epi32(node, t.first_child, node, active, 4);
+      node = _mm256_blendv_epi8(node, _mm256_add_epi32(first, child), active);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(leaf + j), node);
+  }
+  TraverseScalar(t, root, x + j * nf, nf, n - j, leaf + j);
+}
+
+__attribute__((target("avx512f")))
+void TraverseAVX512(const Nodes &t, int root,
+                    const ValueType *x, int nf, int n, int *leaf) {
+  const __m512i lanes = _mm512_mullo_epi32(
+      _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      _mm512_set1_epi32(nf));
+  const __m512i minus_one = _mm512_set1_epi32(-1);
+  const __m512i lt = _mm512_set1_epi32(Node::LT);
+  const __m512i ge = _mm512_set1_epi32(Node::GE);
+  const __m512i unknown = _mm512_set1_epi32(Node::UNKNOWN);
+  const __m512d unknown_value = _mm512_set1_pd(kUnknownValue);
+  // gathers are masked with all lanes on, from a defined source
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512d zero_pd = _mm512_setzero_pd();
+
+  int j = 0;
+  for (; j + 16 <= n; j += 16) {
+    const ValueType *base = x + j * nf;
+    __m512i node = _mm512_set1_epi32(root);
+    for (;;) {
+      __m512i f = _mm512_mask_i32gather_epi32(zero, 0xFFFF, node, t.feature, 4);
+      __mmask16 active = _mm512_cmpgt_epi32_mask(f, minus_one);
+      if (!active) {
+        break;
+      }
+      // leaves read the first feature of the row, which is not used
+      __m512i index = _mm512_mask_add_epi32(lanes, active, lanes, f);
+      __m256i index_lo = _mm512_maskz_extracti64x4_epi64(0xF, index, 0);
+      __m256i index_hi = _mm512_maskz_extracti64x4_epi64(0xF, index, 1);
+      __m256i node_lo = _mm512_maskz_extracti64x4_epi64(0xF, node, 0);
+      __m256i node_hi = _mm512_maskz_extracti64x4_epi64(0xF, node, 1);
+
+      __m512d v_lo = _mm512_mask_i32gather_pd(zero_pd, 0xFF, index_lo, base, 8);
+      __m512d v_hi = _mm512_mask_i32gather_pd(zero_pd, 0xFF, index_hi, base, 8);
+      __m512d t_lo = _mm512_mask_i32gather_pd(zero_pd, 0xFF, node_lo, t.threshold, 8);
+      __m512d t_hi = _mm512_mask_i32gather_pd(zero_pd, 0xFF, node_hi, t.threshold, 8);
+
+      __mmask16 is_ge = static_cast<__mmask16>(
+          _mm512_cmp_pd_mask(v_lo, t_lo, _CMP_NLT_UQ) |
+          (_mm512_cmp_pd_mask(v_hi, t_hi, _CMP_NLT_UQ) << 8));
+      __mmask16 is_unknown = static_cast<__mmask16>(
+          _mm512_cmp_pd_mask(v_lo, unknown_value, _CMP_EQ_OQ) |
+          (_mm512_cmp_pd_mask(v_hi, unknown_value, _CMP_EQ_OQ) << 8));
+      __m512i child = _mm512_mask_blend_epi32(is_ge, lt, ge);
+      child = _mm512_mask_blend_epi32(is_unknown, child, unknown);
+
+      __m512i first = _mm512_mask_i32gather_epi32(node, active, node, t.first_child, 4);
+      node = _mm512_mask_add_epi32(node, active, first, child);
+    }
+    _mm512_storeu_si512(leaf + j, node);
+  }
+  TraverseScalar(t, root, x + j * nf, nf, n - j, leaf + j);
+}
+#endif
+
+TraverseFunc SelectTraverse() {
+#ifdef FLAT_FOREST_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return TraverseAVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return TraverseAVX2;
+  }
+#endif
+  return TraverseScalar;
+}
+
+// rows traversed per call of a kernel
+const int kTraverseRows = 64;
+}
+
+void FlatForest::Build(RegressionTree * const *trees, size_t n) {
+  Clear();
+  for (size_t i = 0; i < n; ++i) {
+    Add(*trees[i]);
+  }
+}
+
+void FlatForest::Add(const RegressionTree &tree) {
+  // a mapped forest is read only
+  assert(root_storage.size() == number_of_trees);
+
+  // (node, prediction), node is NULL for a missing UNKNOWN child,
+  // which becomes a leaf with its parent's prediction
+  typedef std::pair<const Node *, ValueType> Item;
+  std::vector<Item> queue;
+
+  int base = static_cast<int>(feature_storage.size());
+  root_storage.push_back(base);
+
+  const Node *root = tree.GetRoot();
+  assert(root);
+  queue.push_back(Item(root, root->pred));
+
+  for (size_t k = 0; k < queue.size(); ++k) {
+    const Node *node = queue[k].first;
+    if (!node || node->leaf) {
+      feature_storage.push_back(node? LEAF : MISSING);
+      threshold_storage.push_back(0);
+      first_child_storage.push_back(-1);
+      value_storage.push_back(node? node->pred : queue[k].second);
+      continue;
+    }
+
+    feature_storage.push_back(node->index);
+    threshold_storage.push_back(node->value);
+    first_child_storage.push_back(base + static_cast<int>(queue.size()));
+    value_storage.push_back(node->pred);
+
+    queue.push_back(Item(node->child[Node::LT], node->pred));
+    queue.push_back(Item(node->child[Node::GE], node->pred));
+    queue.push_back(Item(node->child[Node::UNKNOWN], node->pred));
+  }
+
+  Attach();
+}
+
+void FlatForest::UsedFeatures(std::vector<int> *features) const {
+  features->clear();
+  for (size_t n = 0; n < number_of_nodes; ++n) {
+    if (feature[n] >= 0) {
+      features->push_back(feature[n]);
+    }
+  }
+  std::sort(features->begin(), features->end());
+  features->erase(std::unique(features->begin(), features->end()), features->end());
+}
+
+void FlatForest::Remap(const FlatForest &other, const std::vector<int> &slot) {
+  root_storage.assign(other.roots, other.roots + other.number_of_trees);
+  feature_storage.assign(other.feature, other.feature + other.number_of_nodes);
+  threshold_storage.assign(other.threshold, other.threshold + other.number_of_nodes);
+  first_child_storage.assign(other.first_child, other.first_child + other.number_of_nodes);
+  value_storage.assign(other.value, other.value + other.number_of_nodes);
+  for (size_t n = 0; n < feature_storage.size(); ++n) {
+    if (feature_storage[n] >= 0) {
+      feature_storage[n] = slot[feature_storage[n]];
+    }
+  }
+  Attach();
+}
+
+void FlatForest::Attach() {
+  number_of_trees = root_storage.size();
+  number_of_nodes = feature_storage.size();
+  roots = root_storage.empty()? NULL : &root_storage[0];
+  feature = feature_storage.empty()? NULL : &feature_storage[0];
+  threshold = threshold_storage.empty()? NULL : &threshold_storage[0];
+  first_child = first_child_storage.empty()? NULL : &first_child_storage[0];
+  value = value_storage.empty()? NULL : &value_storage[0];
+}
+
+// The arrays are serialized as they are in memory: `threshold' and
+// `value' first, so that all of them stay aligned, then `roots',
+// `feature' and `first_child'.
+size_t FlatForest::SerializedSize(size_t n_trees, size_t n_nodes) {
+  return 2 * n_nodes * sizeof(ValueType) + (n_trees + 2 * n_nodes) * sizeof(int);
+}
+
+void FlatForest::Serialize(std::string *out) const {
+  out->append(reinterpret_cast<const char *>(threshold), number_of_nodes * sizeof(ValueType));
+  out->append(reinterpret_cast<const char *>(value), number_of_nodes * sizeof(ValueType));
+  out->append(reinterpret_cast<const char *>(roots), number_of_trees * sizeof(int));
+  out->append(reinterpret_cast<const char *>(feature), number_of_nodes * sizeof(int));
+  out->append(reinterpret_cast<const char *>(first_child), number_of_nodes * sizeof(int));
+}
+
+bool FlatForest::Map(const char *data, size_t n_trees, size_t n_nodes,
+                     int number_of_feature) {
+  if (reinterpret_cast<size_t>(data) % sizeof(ValueType) != 0) {
+    return false;
+  }
+
+  const ValueType *t = reinterpret_cast<const ValueType *>(data);
+  const ValueType *v = t + n_nodes;
+  const int *r = reinterpret_cast<const int *>(v + n_nodes);
+  const int *f = r + n_trees;
+  const int *c = f + n_nodes;
+
+  // children must be in the forest after their parent and split
+  // features in the rows, so that a corrupted model does not make
+  // `PredictTree' loop or read out of the forest or the rows
+  if (n_nodes > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return false;
+  }
+  int n = static_cast<int>(n_nodes);
+  for (size_t i = 0; i < n_trees; ++i) {
+    if (r[i] < 0 || r[i] >= n) {
+      return false;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    if (f[i] < 0) {
+      if (f[i] != LEAF && f[i] != MISSING) {
+        return false;
+      }
+    } else if (f[i] >= number_of_feature || c[i] <= i || c[i] > n - Node::CHILDSIZE) {
+      return false;
+    }
+  }
+
+  Clear();
+  number_of_trees = n_trees;
+  number_of_nodes = n_nodes;
+  threshold = t;
+  value = v;
+  roots = r;
+  feature = f;
+  first_child = c;
+  return true;
+}
+
+Node *FlatForest::Unflatten(int n) const {
+  Node *node = new Node();
+  node->pred = value[n];
+  if (feature[n] < 0) {
+    node->leaf = true;
+    return node;
+  }
+
+  node->index = feature[n];
+  node->value = threshold[n];
+  for (int i = 0; i < Node::CHILDSIZE; ++i) {
+    int child = first_child[n] + i;
+    if (feature[child] != MISSING) {
+      node->child[i] = Unflatten(child);
+    }
+  }
+  return node;
+}
+
+void FlatForest::PredictTree(size_t i, const ValueType *x, int nf, size_t n,
+                             ValueType scale, ValueType *out) const {
+  static const TraverseFunc traverse = SelectTraverse();
+
+  Nodes t = {feature, threshold, first_child};
+  int leaf[kTraverseRows];
+  for (size_t j = 0; j < n; j += kTraverseRows) {
+    int m = static_cast<int>(std::min<size_t>(kTraverseRows, n - j));
+    traverse(t, roots[i], x + j * nf, nf, m, leaf);
+    for (int k = 0; k < m; ++k) {
+      out[j + k] += scale * value[leaf[k]];
+    }
+  }
+}
+
+void FlatForest::Clear() {
+  root_storage.clear();
+  feature_storage.clear();
+  threshold_storage.clear();
+  first_child_storage.clear();
+  value_storage.clear();
+  Attach();
+}
+
+}
@@ -0,0 +1,117 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _FLAT_FOREST_H_
+#define _FLAT_FOREST_H_
+#include <vector>
+#include <string>
+#include "data.hpp"
+#include "tree.hpp"
+
+namespace gbdt {
+
+// Read-only inference layout of a list of regression trees. Nodes of
+// all trees are stored in contiguous arrays (struct of arrays), each
+// tree in breadth-first order, and traversed with a loop instead of
+// recursion.
+//
+// Every internal node has exactly three consecutive children LT, GE
+// and UNKNOWN starting at `first_child'. If a node has no UNKNOWN child,
+// a leaf carrying the node's prediction is added, so that unknown
+// values get the same result as `RegressionTree::Predict'.
+//
+// The arrays are either owned by the forest or mapped from memory laid
+// out by `Serialize', e.g. a binary model file.
+class FlatForest {
+ public:
+  enum {LEAF = -1, MISSING = -2};  // `feature' of leaves, added leaves
+
+  FlatForest(): number_of_trees(0), number_of_nodes(0) { Attach(); }
+
+  void Build(RegressionTree * const *trees, size_t n);
+  // Append a tree, the forest can be built while training.
+  void Add(const RegressionTree &tree);
+  void Clear();
+
+  bool Empty() const { return number_of_trees == 0; }
+  size_t NumberOfTrees() const { return number_of_trees; }
+  size_t NumberOfNodes() const { return number_of_nodes; }
+
+  // Append the arrays to `out'. They take `SerializedSize' bytes, and
+  // `out' has to be 8 bytes aligned for `Map'.
+  void Serialize(std::string *out) const;
+  static size_t SerializedSize(size_t n_trees, size_t n_nodes);
+  // Use the arrays serialized at `data' in place. `data' must be 8
+  // bytes aligned and outlive the forest. Return false if the arrays
+  // are not valid, e.g. they have a cycle or split on a feature not
+  // below `number_of_feature'.
+  bool Map(const char *data, size_t n_trees, size_t n_nodes, int number_of_feature);
+
+  // Sorted features used by the splits.
+  void UsedFeatures(std::vector<int> *features) const;
+  // Become a copy of `other' whose split feature `f' is renumbered to
+  // `slot[f]', e.g. to the position of `f' in `UsedFeatures'.
+  void Remap(const FlatForest &other, const std::vector<int> &slot);
+
+  // Tree `i' as nodes, which the caller owns.
+  Node *Unflatten(size_t i) const { return Unflatten(roots[i]); }
+
+  // `x[f]' gives the value of feature `f', e.g. `Tuple::feature'.
+  template <typename Row>
+  ValueType PredictTree(size_t i, const Row &x) const {
+    int n = roots[i];
+    while (feature[n] >= 0) {
+      ValueType v = x[feature[n]];
+      if (v == kUnknownValue) {
+        n = first_child[n] + Node::UNKNOWN;
+      } else if (v < threshold[n]) {
+        n = first_child[n] + Node::LT;
+      } else {
+        n = first_child[n] + Node::GE;
+      }
+    }
+    return value[n];
+  }
+
+  // Add `scale' times the prediction of tree `i' to `out' for `n' rows
+  // of `x', stored row by row with `nf' features each. Several rows are
+  // traversed at once with AVX2/AVX-512 when the cpu supports them.
+  void PredictTree(size_t i, const ValueType *x, int nf, size_t n,
+                   ValueType scale, ValueType *out) const;
+
+ private:
+  // point the arrays to the owned storage
+  void Attach();
+  Node *Unflatten(int n) const;
+
+  size_t number_of_trees;
+  size_t number_of_nodes;
+
+  const int *roots;
+  const int *feature;              // split feature, `LEAF' or `MISSING'
+  const ValueType *threshold;
+  const int *first_child;
+  const ValueType *value;          // prediction of the node
+
+  // storage of a forest built from trees
+  std::vector<int> root_storage;
+  std::vector<int> feature_storage;
+  std::vector<ValueType> threshold_storage;
+  std::vector<int> first_child_storage;
+  std::vector<ValueType> value_storage;
+
+  DISALLOW_COPY_AND_ASSIGN(FlatForest);
+};
+
+// Row accessor of a dataset for `FlatForest::PredictTree'
+class DatasetRow {
+ public:
+  DatasetRow(const Dataset &d, size_t row): d(d), row(row) {}
+  ValueType operator[](int f) const { return d.GetValue(f, row); }
+ private:
+  const Dataset &d;
+  size_t row;
+};
+
+}
+
+#endif /* _FLAT_FOREST_H_ */
@@ -0,0 +1,177 @@
+#include "gbdt.hpp"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "loss.hpp"
+
+using namespace gbdt;
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  Configure conf;
+  conf.number_of_feature = 3;
+  conf.max_depth = 5;
+  conf.iterations = 10;
+  conf.shrinkage = 0.1;
+  conf.loss.reset(LossFactory::GetInstance()->Create("SquaredError"));
+
+  DataVector d;
+  bool r = LoadDataFromFile("../../data/train.txt",
+                            &d,
+                            conf.number_of_feature,
+                            false);
+  assert(r);
+
+  // make some values unknown, so that UNKNOWN children are grown
+  std::srand(0);
+  for (size_t i = 0; i < d.size(); ++i) {
+    if (std::rand() % 5 == 0) {
+      d[i]->feature[std::rand() % conf.number_of_feature] = kUnknownValue;
+    }
+  }
+
+  GBDT gbdt(conf);
+  gbdt.Fit(&d);
+
+  GBDT loaded(conf);
+  loaded.Load(gbdt.Save());
+
+  // batch prediction must give exactly the same result row by row
+  PredictVector batch(d.size());
+  gbdt.PredictBatch(&d[0], d.size(), &batch[0]);
+  for (size_t i = 0; i < d.size(); ++i) {
+    assert(batch[i] == gbdt.Predict(*d[i]));
+  }
+
+  // flat layout must give exactly the same result as walking the trees
+  double *p = new double[conf.number_of_feature];
+  for (size_t i = 0; i < d.size(); ++i) {
+    for (int k = 0; k < 2; ++k) {
+      // all known, then all unknown
+      if (k == 1) {
+        for (int j = 0; j < conf.number_of_feature; ++j) {
+          d[i]->feature[j] = kUnknownValue;
+        }
+      }
+      ValueType expected = gbdt.Predict(*d[i], p);
+      assert(gbdt.Predict(*d[i]) == expected);
+      assert(loaded.Predict(*d[i]) == loaded.Predict(*d[i], p));
+    }
+  }
+  delete[] p;
+
+  // binary model is used in place, and converts back to the same text
+  std::string binary = gbdt.SaveBinary();
+  assert(GBDT::IsBinaryModel(binary.data(), binary.size()));
+  GBDT mapped(conf);
+  r = mapped.LoadBinary(binary.data(), binary.size());
+  assert(r);
+  assert(!mapped.LoadBinary(binary.data(), binary.size() - 1));
+  GBDT text(conf);
+  text.Load(mapped.Save());
+  for (size_t i = 0; i < d.size(); ++i) {
+    assert(mapped.Predict(*d[i]) == gbdt.Predict(*d[i]));
+    assert(text.Predict(*d[i]) == loaded.Predict(*d[i]));
+  }
+  assert(text.Save() == loaded.Save());
+
+  // all unknown rows go down the UNKNOWN children in the batch kernels too
+  gbdt.PredictBatch(&d[0], d.size(), &batch[0]);
+  for (size_t i = 0; i < d.size(); ++i) {
+    assert(batch[i] == gbdt.Predict(*d[i]));
+  }
+
+  // corrupted arrays are rejected: a child before its parent, a split
+  // feature out of the rows and an unknown negative feature code
+  RegressionTree stump(conf);
+  stump.Load("0 0.5 0 1 1 2 0\n-1 0 1 2 0 0 0\n-1 0 1 3 0 0 0");
+  FlatForest small;
+  small.Add(stump);
+  size_t nodes = small.NumberOfNodes();
+  std::string arrays;
+  small.Serialize(&arrays);
+  std::vector<double> aligned(arrays.size() / sizeof(double) + 1);
+  char *data = reinterpret_cast<char *>(&aligned[0]);
+  int *feature = reinterpret_cast<int *>(data + 2 * nodes * sizeof(double) + sizeof(int));
+  int *first_child = feature + nodes;
+  int corruptions[][3] = {{0, 0, 0}, {1, 0, 3}, {1, 1, -3}, {2, 0, 0}, {2, 0, -1}};
+  for (size_t k = 0; k < sizeof(corruptions) / sizeof(corruptions[0]); ++k) {
+    std::memcpy(data, arrays.data(), arrays.size());
+    int *target = corruptions[k][0] == 1? feature : first_child;
+    if (corruptions[k][0] != 0) {
+      target[corruptions[k][1]] = corruptions[k][2];
+    }
+    FlatForest mapped_small;
+    r = mapped_small.Map(data, 1, nodes, conf.number_of_feature);
+    assert(r == (corruptions[k][0] == 0));
+  }
+
+  // in histogram mode bins are saved with the model, and data
+  // quantized with them predicts the same as the raw values
+  Configure hist_conf = conf;
+  hist_conf.enable_histogram = true;
+  hist_conf.max_bins = 16;
+  Dataset train;
+  r = LoadDataFromFile("../../data/train.txt", &train, conf.number_of_feature, false);
+  assert(r);
+  GBDT hist(hist_conf);
+  hist.Fit(&train);
+  GBDT hist_text(hist_conf);
+  hist_text.Load(hist.Save());
+  binary = hist.SaveBinary();
+  GBDT hist_mapped(hist_conf);
+  r = hist_mapped.LoadBinary(binary.data(), binary.size());
+  assert(r);
+  assert(!hist_mapped.LoadBinary(binary.data(), binary.size() - 1));
+  r = hist_mapped.LoadBinary(binary.data(), binary.size());
+  assert(r && hist_mapped.GetBinMapper().NumberOfFeature() == conf.number_of_feature);
+  for (int f = 0; f < conf.number_of_feature; ++f) {
+    assert(hist_mapped.GetBinMapper().Bounds(f) == hist.GetBinMapper().Bounds(f));
+    assert(hist_text.GetBinMapper().Bounds(f) == hist.GetBinMapper().Bounds(f));
+  }
+  assert(mapped.GetBinMapper().NumberOfFeature() == 0);
+
+  // bounds keep all their digits in a text model
+  Configure thirds_conf = hist_conf;
+  thirds_conf.number_of_feature = 1;
+  thirds_conf.iterations = 2;
+  Dataset thirds;
+  thirds.Reset(100, 1);
+  for (size_t i = 0; i < thirds.Size(); ++i) {
+    thirds.Column(0)[i] = static_cast<ValueType>(i) / 3;
+    thirds.label[i] = static_cast<ValueType>(i % 7);
+    thirds.weight[i] = 1;
+  }
+  GBDT thirds_model(thirds_conf);
+  thirds_model.Fit(&thirds);
+  GBDT thirds_text(thirds_conf);
+  thirds_text.Load(thirds_model.Save());
+  assert(thirds_model.GetBinMapper().Bounds(0).size() > 1);
+  assert(thirds_text.GetBinMapper().Bounds(0) == thirds_model.GetBinMapper().Bounds(0));
+
+  DataVector test;
+  r = LoadDataFromFile("../../data/test.txt", &test, conf.number_of_feature, false);
+  assert(r);
+  Dataset quantized;
+  r = LoadDataFromFile("../../data/test.txt", &quantized, conf.number_of_feature, false);
+  assert(r);
+  quantized.Quantize(hist_text.GetBinMapper());
+  for (size_t i = 0; i < test.size(); ++i) {
+    Tuple binned;
+    binned.feature = new ValueType[conf.number_of_feature];
+    for (int f = 0; f < conf.number_of_feature; ++f) {
+      binned.feature[f] = quantized.GetValue(f, i);
+    }
+    assert(hist_text.Predict(binned) == hist_text.Predict(*test[i]));
+  }
+  CleanDataVector(&test);
+
+  std::cout << "flat forest ok" << std::endl;
+
+  CleanDataVector(&d);
+  return 0;
+}
@@ -7,12 +7,54 @@
 #include <iostream>
 #include <cmath>
 #include <cassert>
+#include <cstdlib>
 #include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <stdint.h>
 #include "time.hpp"
 
+namespace {
+
+// rows by decreasing magnitude of gradient
+struct GradientGreater {
+  GradientGreater(const gbdt::ValueType *target): target(target) {}
+
+  bool operator () (size_t i, size_t j) const {
+    return std::fabs(target[i]) > std::fabs(target[j]);
+  }
+
+  const gbdt::ValueType *target;
+};
+
+}
+
 namespace gbdt {
+static const size_t kBatchBlockBytes = 128 * 1024;
+static const size_t kGradientBatchSize = 4096;
+
+// Header of a binary model, followed by `FlatForest::Serialize'. All
+// fields are little-endian, and the header size keeps the arrays 8
+// bytes aligned. If there are bin boundaries, they follow at the next
+// multiple of 8 bytes: the number of boundaries of each feature as
+// uint64_t, then the boundaries.
+struct BinaryModelHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t value_size;         // sizeof(ValueType)
+  uint32_t number_of_trees;
+  uint32_t number_of_nodes;
+  uint32_t number_of_binned_features;  // 0 without bin boundaries
+  double shrinkage;
+  double bias;
+};
+
+static const char kBinaryModelMagic[4] = {'G', 'B', 'D', 'T'};
+static const uint32_t kBinaryModelVersion = 1;
+static const std::string kBinsTag = "bins";
+
 ValueType GBDT::Predict(const Tuple &t, size_t n) const {
-  if (!trees)
+  if (!trees && forest.Empty())
     return kUnknownValue;
 
   assert(n <= iterations);
@@ -22,6 +64,33 @@ ValueType GBDT::Predict(const Tuple &t, size_t n) const {
     r = t.initial_guess;
   }
 
+  if (!forest.Empty() && t.feature) {
+    for (size_t i = 0; i < n; ++i) {
+      r += shrinkage * forest.PredictTree(i, t.feature);
+    }
+    return r;
+  }
+
+  if (!forest.Empty() && !compact_forest.Empty()) {
+    std::vector<ValueType> x(used_features.size() + 1);
+    t.Gather(used_features.data(), used_features.size(), &x[0]);
+    for (size_t i = 0; i < n; ++i) {
+      r += shrinkage * compact_forest.PredictTree(i, &x[0]);
+    }
+    return r;
+  }
+
+  if (!forest.Empty()) {
+    std::vector<ValueType> x(conf.number_of_feature, kUnknownValue);
+    for (size_t f = 0; f < t.known.size(); ++f) {
+      x[t.known[f].first] = t.known[f].second;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      r += shrinkage * forest.PredictTree(i, &x[0]);
+    }
+    return r;
+  }
+
   for (size_t i = 0; i < n; ++i) {
     r += shrinkage * trees[i]->Predict(t);
   }
@@ -47,46 +116,201 @@ ValueType GBDT::Predict(const Tuple &t, size_t n, double *p) const {
   return r;
 }
 
-void GBDT::Init(DataVector &d, size_t len) {
-  assert(d.size() >= len);
+size_t GBDT::BatchBlockSize(size_t nf) const {
+  // feature values of a block take about half of a 256KB L2 cache
+  size_t bytes = nf * sizeof(ValueType);
+  size_t block = kBatchBlockBytes / std::max<size_t>(bytes, 1);
+  return std::min<size_t>(std::max<size_t>(block, 16), 4096);
+}
+
+void GBDT::PredictBatch(const Tuple * const *rows, size_t n, ValueType *out) const {
+  if (!trees && forest.Empty()) {
+    std::fill(out, out + n, kUnknownValue);
+    return;
+  }
+
+  // the quick scorer and `forest' take all the features, the compact
+  // forest only the used ones
+  bool all_features = !quick_scorer.Empty() || compact_forest.Empty();
+  int nf = all_features? conf.number_of_feature
+      : std::max(static_cast<int>(used_features.size()), 1);
+  size_t block = BatchBlockSize(nf);
+  size_t blocks = (n + block - 1) / block;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t k = 0; k < blocks; ++k) {
+    size_t begin = k * block;
+    size_t end = std::min(n, begin + block);
+    // features of the block row by row, for the traversal kernels
+    std::vector<ValueType> x((end - begin) * nf, kUnknownValue);
+    for (size_t j = begin; j < end; ++j) {
+      const Tuple &t = *rows[j];
+      ValueType *row = &x[(j - begin) * nf];
+      out[j] = conf.enable_initial_guess? t.initial_guess : bias;
+      if (!all_features) {
+        t.Gather(used_features.data(), used_features.size(), row);
+      } else if (t.feature) {
+        std::copy(t.feature, t.feature + nf, row);
+      } else {
+        for (size_t f = 0; f < t.known.size(); ++f) {
+          row[t.known[f].first] = t.known[f].second;
+        }
+      }
+    }
+    if (!quick_scorer.Empty()) {
+      quick_scorer.Predict(&x[0], nf, end - begin, shrinkage, out + begin);
+      continue;
+    }
+    const FlatForest &f = all_features? forest : compact_forest;
+    for (size_t i = 0; i < iterations; ++i) {
+      f.PredictTree(i, &x[0], nf, end - begin, shrinkage, out + begin);
+    }
+  }
+}
+
+void SampleByGradient(Dataset *d, size_t *rows, size_t top, size_t samples) {
+  size_t len = d->Size();
+  assert(top <= samples && samples <= len);
+
+  std::nth_element(rows, rows + top, rows + len, GradientGreater(&d->target[0]));
+
+  // pick the others by a partial Fisher-Yates shuffle of the rest
+  for (size_t j = top; j < samples; ++j) {
+    std::swap(rows[j], rows[j + std::rand() % (len - j)]);
+  }
+
+  if (samples > top) {
+    ValueType scale = static_cast<ValueType>(len - top) /
+                      static_cast<ValueType>(samples - top);
+    for (size_t j = top; j < samples; ++j) {
+      d->weight[rows[j]] *= scale;
+    }
+  }
+}
+
+void GBDT::UpdateScore(const Dataset &d, const size_t *rows, size_t samples, size_t i,
+                       const ValueType *leaf_pred, ValueType *score) const {
+  assert(i < forest.NumberOfTrees());
+
+  size_t len = d.Size();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+  for (size_t j = 0; j < len; ++j) {
+    size_t r = rows[j];
+    ValueType v = j < samples? leaf_pred[r] : forest.PredictTree(i, DatasetRow(d, r));
+    score[r] += shrinkage * v;
+  }
+}
+
+void GBDT::BuildCompactForest() {
+  if (!conf.enable_sparse_input) {
+    return;
+  }
+  forest.UsedFeatures(&used_features);
+  std::vector<int> slot(used_features.empty()? 0 : used_features.back() + 1, -1);
+  for (size_t i = 0; i < used_features.size(); ++i) {
+    slot[used_features[i]] = static_cast<int>(i);
+  }
+  compact_forest.Remap(forest, slot);
+}
+
+void GBDT::Init(const Dataset &d, const size_t *rows, size_t len) {
+  assert(d.Size() >= len);
 
   if (conf.enable_initial_guess) {
     return;
   }
 
-  bias = conf.loss->GetBias(d, len);
+  bias = conf.loss->GetBias(d, rows, len);
 }
 
 void GBDT::Fit(DataVector *d) {
+  Dataset data;
+  data.FromDataVector(*d, d->size(), conf.number_of_feature);
+  Fit(&data);
+}
+
+void GBDT::Fit(Dataset *d) {
   ReleaseTrees();
   trees = new RegressionTree*[conf.iterations];
   for (int i = 0; i < conf.iterations; ++i) {
     trees[i] = new RegressionTree(conf);
   }
 
-  size_t samples = d->size();
-  if (conf.data_sample_ratio < 1) {
-    samples = static_cast<size_t>(d->size() * conf.data_sample_ratio);
+  // the forest grows with the trees, which are used to compute the
+  // gradient of the next iteration
+  forest.Clear();
+
+  std::vector<size_t> rows(d->Size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    rows[i] = i;
+  }
+
+  size_t samples = d->Size();
+  size_t top = 0;
+  // original weights, of the rows reweighted by GOSS
+  std::vector<ValueType> weight;
+  if (conf.enable_goss) {
+    double size = static_cast<double>(d->Size());
+    top = static_cast<size_t>(size * conf.goss_top_ratio);
+    samples = std::min(d->Size(),
+                       top + static_cast<size_t>(size * conf.goss_other_ratio));
+    weight = d->weight;
+  } else if (conf.data_sample_ratio < 1) {
+    samples = static_cast<size_t>(d->Size() * conf.data_sample_ratio);
   }
 
-  Init(*d, d->size());
+  Init(*d, &rows[0], rows.size());
+
+  // quantize features once, all the trees share the same bins
+  if (conf.enable_histogram && !d->IsQuantized()) {
+    d->Quantize(conf.max_bins, conf.enable_feature_bundling);
+  }
+  bin_mapper = d->IsQuantized()? d->GetBinMapper() : BinMapper();
+
+  // prediction of the trees fitted so far, updated after each tree, so
+  // that the gradient does not traverse all the previous trees
+  std::vector<ValueType> score(d->Size());
+  for (size_t i = 0; i < score.size(); ++i) {
+    score[i] = conf.enable_initial_guess? d->initial_guess[i] : bias;
+  }
+  std::vector<ValueType> leaf_pred(d->Size());
 
   for (size_t i = 0; i < conf.iterations; ++i) {
-    if (samples < d->size()) {
-      std::random_shuffle(d->begin(), d->end());
+    if (!conf.enable_goss && samples < d->Size()) {
+      std::random_shuffle(rows.begin(), rows.end());
     }
 
     Elapsed elapsed;
-    UpdateGradient(d, samples, i);
-    trees[i]->Fit(d, samples);
+    if (conf.enable_goss) {
+      // GOSS samples by gradients, which are needed for all the rows
+      UpdateGradient(d, &rows[0], rows.size(), &score[0]);
+      SampleByGradient(d, &rows[0], top, samples);
+    } else {
+      UpdateGradient(d, &rows[0], samples, &score[0]);
+    }
+    trees[i]->Fit(*d, &rows[0], samples, &leaf_pred[0]);
+    for (size_t j = top; j < samples && conf.enable_goss; ++j) {
+      d->weight[rows[j]] = weight[rows[j]];
+    }
+    forest.Add(*trees[i]);
     long fitting_time = elapsed.Tell().ToMilliseconds();
     if (conf.debug) {
       std::cout  << "iteration: " << i << ", time: " << fitting_time << " milliseconds"
-                 << ", loss: " << GetLoss(d, samples, i) << std::endl;
+                 << ", loss: " << GetLoss(*d, &rows[0],
+                                          conf.enable_goss? rows.size() : samples,
+                                          &score[0]) << std::endl;
+    }
+    if (i + 1 < conf.iterations) {
+      UpdateScore(*d, &rows[0], samples, i, &leaf_pred[0], &score[0]);
     }
   }
 
 
+  BuildCompactForest();
+
   // Calculate gain
   delete[] gain;
   gain = new double[conf.number_of_feature];
@@ -108,30 +332,210 @@ std::string GBDT::Save() const {
   vs.push_back(std::to_string(shrinkage));
   vs.push_back(std::to_string(bias));
   for (size_t i = 0; i < iterations; ++i) {
-    vs.push_back(trees[i]->Save());
+    if (trees) {
+      vs.push_back(trees[i]->Save());
+    } else {
+      // loaded from a binary model
+      RegressionTree tree(conf);
+      tree.SetRoot(forest.Unflatten(i));
+      vs.push_back(tree.Save());
+    }
+  }
+  if (bin_mapper.NumberOfFeature() > 0) {
+    vs.push_back(SaveBins());
   }
   return JoinString(vs, "\n;\n");
 }
 
+std::string GBDT::SaveBins() const {
+  // `kBinsTag' and the number of features, then the boundaries of
+  // each feature in a line, with all their digits so that data is
+  // binned the same after loading
+  std::string s = kBinsTag + " " + std::to_string(bin_mapper.NumberOfFeature());
+  for (int f = 0; f < bin_mapper.NumberOfFeature(); ++f) {
+    const std::vector<ValueType> &b = bin_mapper.Bounds(f);
+    s += "\n";
+    for (size_t i = 0; i < b.size(); ++i) {
+      if (i > 0) s += " ";
+      s += DoubleLiteral(b[i]);
+    }
+  }
+  return s;
+}
+
+void GBDT::LoadBins(const std::string &s) {
+  std::vector<std::string> lines;
+  SplitString(s, "\n", &lines);
+  int nf = std::stoi(lines[0].substr(kBinsTag.size()));
+  lines.resize(nf + 1);
+  std::vector<std::vector<ValueType> > bounds(nf);
+  for (int f = 0; f < nf; ++f) {
+    std::vector<std::string> items;
+    SplitString(lines[f+1], " ", &items);
+    for (size_t i = 0; i < items.size(); ++i) {
+      bounds[f].push_back(std::stod(items[i]));
+    }
+  }
+  bin_mapper.SetBounds(bounds);
+}
+
+std::string GBDT::SaveBinary() const {
+  assert(IsLittleEndian());
+
+  BinaryModelHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kBinaryModelMagic, sizeof(header.magic));
+  header.version = kBinaryModelVersion;
+  header.value_size = sizeof(ValueType);
+  header.number_of_trees = static_cast<uint32_t>(forest.NumberOfTrees());
+  header.number_of_nodes = static_cast<uint32_t>(forest.NumberOfNodes());
+  header.number_of_binned_features = static_cast<uint32_t>(bin_mapper.NumberOfFeature());
+  header.shrinkage = shrinkage;
+  header.bias = bias;
+
+  std::string s(reinterpret_cast<const char *>(&header), sizeof(header));
+  forest.Serialize(&s);
+  if (header.number_of_binned_features > 0) {
+    s.resize((s.size() + 7) / 8 * 8, '\0');
+    std::vector<uint64_t> counts;
+    std::vector<ValueType> bounds;
+    for (int f = 0; f < bin_mapper.NumberOfFeature(); ++f) {
+      const std::vector<ValueType> &b = bin_mapper.Bounds(f);
+      counts.push_back(b.size());
+      bounds.insert(bounds.end(), b.begin(), b.end());
+    }
+    s.append(reinterpret_cast<const char *>(counts.data()), counts.size() * sizeof(uint64_t));
+    s.append(reinterpret_cast<const char *>(bounds.data()), bounds.size() * sizeof(ValueType));
+  }
+  return s;
+}
+
+bool GBDT::IsBinaryModel(const char *data, size_t size) {
+  return size >= sizeof(BinaryModelHeader) &&
+      std::memcmp(data, kBinaryModelMagic, sizeof(kBinaryModelMagic)) == 0;
+}
+
+bool GBDT::LoadBinary(const char *data, size_t size) {
+  if (!IsLittleEndian() || !IsBinaryModel(data, size)) {
+    return false;
+  }
+
+  BinaryModelHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.version != kBinaryModelVersion ||
+      header.value_size != sizeof(ValueType) ||
+      size < sizeof(header) + FlatForest::SerializedSize(header.number_of_trees,
+                                                         header.number_of_nodes)) {
+    return false;
+  }
+
+  // bin boundaries are copied, they are small
+  std::vector<std::vector<ValueType> > bounds(header.number_of_binned_features);
+  if (!bounds.empty()) {
+    size_t offset = sizeof(header) + FlatForest::SerializedSize(header.number_of_trees,
+                                                                header.number_of_nodes);
+    offset = (offset + 7) / 8 * 8;
+    if (offset > size || (size - offset) / sizeof(uint64_t) < bounds.size()) {
+      return false;
+    }
+    std::vector<uint64_t> counts(bounds.size());
+    std::memcpy(counts.data(), data + offset, counts.size() * sizeof(uint64_t));
+    offset += counts.size() * sizeof(uint64_t);
+    for (size_t f = 0; f < bounds.size(); ++f) {
+      if (counts[f] > (size - offset) / sizeof(ValueType)) {
+        return false;
+      }
+      bounds[f].resize(counts[f]);
+      std::memcpy(bounds[f].data(), data + offset, counts[f] * sizeof(ValueType));
+      offset += counts[f] * sizeof(ValueType);
+    }
+  }
+
+  ReleaseTrees();
+  if (!forest.Map(data + sizeof(header), header.number_of_trees, header.number_of_nodes,
+                  conf.number_of_feature)) {
+    return false;
+  }
+  bin_mapper.SetBounds(bounds);
+
+  iterations = header.number_of_trees;
+  conf.iterations = static_cast<int>(iterations);
+  shrinkage = header.shrinkage;
+  bias = header.bias;
+  BuildCompactForest();
+
+  if (conf.enable_quick_scorer && iterations > 0) {
+    std::vector<RegressionTree *> t(iterations);
+    for (size_t i = 0; i < iterations; ++i) {
+      t[i] = new RegressionTree(conf);
+      t[i]->SetRoot(forest.Unflatten(i));
+    }
+    quick_scorer.Build(&t[0], t.size());
+    for (size_t i = 0; i < iterations; ++i) {
+      delete t[i];
+    }
+  }
+  return true;
+}
+
+std::string GBDT::Compile(const std::string &function) const {
+  std::ostringstream out;
+  out << "// Generated by gbdt_compile, do not edit.\n"
+      << "#include <limits>\n\n"
+      << "namespace {\n"
+      << "const double kUnknownValue = std::numeric_limits<double>::min();\n";
+  for (size_t i = 0; i < iterations; ++i) {
+    std::string name = "Tree" + std::to_string(i);
+    if (trees) {
+      out << "\n" << trees[i]->Compile(name);
+    } else {
+      // loaded from a binary model
+      RegressionTree tree(conf);
+      tree.SetRoot(forest.Unflatten(i));
+      out << "\n" << tree.Compile(name);
+    }
+  }
+  out << "}\n\n"
+      << "extern \"C\" double " << function << "(const double *features) {\n"
+      << "  double r = " << DoubleLiteral(bias) << ";\n";
+  for (size_t i = 0; i < iterations; ++i) {
+    out << "  r += " << DoubleLiteral(shrinkage) << " * Tree" << i << "(features);\n";
+  }
+  out << "  return r;\n"
+      << "}\n";
+  return out.str();
+}
+
 void GBDT::Load(const std::string &s) {
   delete[] trees;
   std::vector<std::string> vs;
   SplitString(s, "\n;\n", &vs);
 
+  bin_mapper = BinMapper();
+  if (vs.size() > 2 && vs.back().compare(0, kBinsTag.size(), kBinsTag) == 0) {
+    LoadBins(vs.back());
+    vs.pop_back();
+  }
+
   iterations = vs.size() - 2;
   shrinkage = std::stod(vs[0]);
   bias = std::stod(vs[1]);
 
   ReleaseTrees();
 
-  conf.iterations = iterations;
+  conf.iterations = static_cast<int>(iterations);
   trees = new RegressionTree*[iterations];
-  for (int i = 0; i < iterations; ++i) {
+  for (size_t i = 0; i < iterations; ++i) {
     trees[i] = new RegressionTree(conf);
   }
   for (size_t i = 0; i < iterations; ++i) {
     trees[i]->Load(vs[i+2]);
   }
+  forest.Build(trees, iterations);
+  BuildCompactForest();
+  if (conf.enable_quick_scorer) {
+    quick_scorer.Build(trees, iterations);
+  }
 }
 
 GBDT::~GBDT() {
@@ -139,24 +543,31 @@ GBDT::~GBDT() {
   delete[] gain;
 }
 
-void GBDT::UpdateGradient(DataVector *d, size_t samples, int i) {
+void GBDT::UpdateGradient(Dataset *d, const size_t *rows, size_t samples,
+                          const ValueType *score) {
+  // batches of rows, each a single call of the objective
+  size_t batches = (samples + kGradientBatchSize - 1) / kGradientBatchSize;
 #ifdef USE_OPENMP
 #pragma omp parallel for
 #endif
-  for (size_t j = 0; j < samples; ++j) {
-    ValueType p = Predict(*(d->at(j)), i);
-    conf.loss->UpdateGradient(d->at(j), p);
+  for (size_t k = 0; k < batches; ++k) {
+    size_t begin = k * kGradientBatchSize;
+    size_t n = std::min(kGradientBatchSize, samples - begin);
+    conf.loss->UpdateGradients(d, rows + begin, n, score);
   }
 }
 
-double GBDT::GetLoss(DataVector *d, size_t samples, int i) {
+double GBDT::GetLoss(const Dataset &d, const size_t *rows, size_t samples,
+                     const ValueType *score) {
   double s = 0.0;
+  size_t batches = (samples + kGradientBatchSize - 1) / kGradientBatchSize;
 #ifdef USE_OPENMP
 #pragma omp parallel for reduction(+:s)
 #endif
-  for (size_t j = 0; j < samples; ++j) {
-    ValueType p = Predict(*(d->at(j)), i);
-    s += conf.loss->GetLoss(*(d->at(j)), p);
+  for (size_t k = 0; k < batches; ++k) {
+    size_t begin = k * kGradientBatchSize;
+    size_t n = std::min(kGradientBatchSize, samples - begin);
+    s += conf.loss->GetTotalLoss(d, rows + begin, n, score);
   }
 
   return s/samples;
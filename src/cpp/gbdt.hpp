@@ -2,8 +2,16 @@
 #ifndef _GBDT_H_
 #define _GBDT_H_
 #include "tree.hpp"
+#include "flat_forest.hpp"
+#include "quick_scorer.hpp"
 
 namespace gbdt {
+// Gradient-based one-side sampling: move the `top' rows with the
+// largest gradients to the front of `rows', followed by `samples -
+// top' rows sampled from the rest, whose weights in `d' are scaled up
+// to stand for all the rest.
+void SampleByGradient(Dataset *d, size_t *rows, size_t top, size_t samples);
+
 class GBDT {
  public:
   GBDT(Configure conf): trees(NULL),
@@ -15,6 +23,8 @@ class GBDT {
   }
 
   void Fit(DataVector *d);
+  // In histogram mode, `d' is quantized in place if it is not yet.
+  void Fit(Dataset *d);
   ValueType Predict(const Tuple &t) const {
     return Predict(t, iterations);
   }
@@ -23,21 +33,65 @@ class GBDT {
     return Predict(t, iterations, p);
   }
 
+  // Predict `n' tuples into `out'. Rows are scored in blocks, all trees
+  // in turn over a block, so that each tree stays in cache while it
+  // scores the block.
+  void PredictBatch(const Tuple * const *rows, size_t n, ValueType *out) const;
+
   std::string Save() const;
   void Load(const std::string &s);
 
+  // Binary model: a little-endian header followed by the arrays of the
+  // flat forest, see gbdt.cpp.
+  std::string SaveBinary() const;
+  // Predict with the binary model at `data' in place, without building
+  // the trees. `data' must be 8 bytes aligned and outlive the model.
+  // `Predict' with feature gains is not available for such a model.
+  bool LoadBinary(const char *data, size_t size);
+  static bool IsBinaryModel(const char *data, size_t size);
+  // Standalone C++ source exporting `extern "C" double function(const
+  // double *features)', which returns the same as `Predict' without
+  // initial guess.
+  std::string Compile(const std::string &function) const;
+
   double *GetGain() { return gain; }
 
+  // Bin boundaries of the training data in histogram mode, saved with
+  // the model, e.g. for `Dataset::Quantize' of data to predict. Empty
+  // otherwise.
+  const BinMapper &GetBinMapper() const { return bin_mapper; }
+
   ~GBDT();
  private:
   ValueType Predict(const Tuple &t, size_t n) const;
   ValueType Predict(const Tuple &t, size_t n, double *p) const;
-  void Init(DataVector &d, size_t len);
+  // number of rows of `nf' features in a block of `PredictBatch'
+  size_t BatchBlockSize(size_t nf) const;
+  void Init(const Dataset &d, const size_t *rows, size_t len);
 
-  void UpdateGradient(DataVector *d, size_t samples, int iteration);
-  double GetLoss(DataVector *d, size_t samples, int i);
+  // `score' is the prediction of the trees fitted so far, by row of `d'.
+  void UpdateGradient(Dataset *d, const size_t *rows, size_t samples,
+                      const ValueType *score);
+  double GetLoss(const Dataset &d, const size_t *rows, size_t samples,
+                 const ValueType *score);
+  // Add tree `i' to `score', taking the leaf predictions of the first
+  // `samples' rows, which tree `i' is fitted on, from `leaf_pred'.
+  void UpdateScore(const Dataset &d, const size_t *rows, size_t samples, size_t i,
+                   const ValueType *leaf_pred, ValueType *score) const;
+
+  // Build `compact_forest' from `forest' if `conf.enable_sparse_input'
+  // is set. It is a copy on the heap, which a mapped binary model had
+  // better do without for dense tuples.
+  void BuildCompactForest();
+
+  std::string SaveBins() const;
+  void LoadBins(const std::string &s);
 
   void ReleaseTrees() {
+    forest.Clear();
+    compact_forest.Clear();
+    used_features.clear();
+    quick_scorer.Clear();
     if (trees) {
       for (int i = 0; i < iterations; ++i) {
         delete trees[i];
@@ -55,6 +109,20 @@ class GBDT {
 
   Configure conf;
 
+  // inference layout of `trees', built after fitting or loading
+  FlatForest forest;
+  // `forest' with the features it uses, `used_features', renumbered
+  // 0, 1, ..., so that a row is only gathered from the used features,
+  // which is cheap for sparse tuples. Without it, sparse tuples are
+  // scattered into all the features.
+  FlatForest compact_forest;
+  std::vector<int> used_features;
+  // built after loading if `conf.enable_quick_scorer' is set, used by
+  // `PredictBatch'
+  QuickScorer quick_scorer;
+
+  BinMapper bin_mapper;
+
   double *gain;
 
   DISALLOW_COPY_AND_ASSIGN(GBDT);
@@ -0,0 +1,67 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "gbdt.hpp"
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "cmd_option.hpp"
+
+using namespace gbdt;
+
+// Compile a model saved by `gbdt_train', or a binary one, to a C++
+// source file, which can be built into a program to predict without
+// loading the model.
+int main(int argc, char *argv[]) {
+  CmdOption opt;
+  opt.AddOption("model", "m", "model", OptionType::STRING, true);
+  opt.AddOption("output", "o", "output", "");
+  opt.AddOption("function", "f", "function", "predict");
+
+  if (!opt.ParseOptions(argc, argv)) {
+    opt.Help();
+    return -1;
+  }
+
+  std::string model_path;
+  opt.Get("model", &model_path);
+  // a binary model is used in place, so the mapping lives as long as
+  // `gbdt'
+  MappedFile model;
+  if (!model.Open(model_path)) {
+    std::cerr << "failed to open model " << model_path << std::endl;
+    return -1;
+  }
+
+  // split features are not bounded by rows here
+  Configure conf;
+  conf.number_of_feature = std::numeric_limits<int>::max();
+  GBDT gbdt(conf);
+  if (GBDT::IsBinaryModel(model.Data(), model.Size())) {
+    if (!gbdt.LoadBinary(model.Data(), model.Size())) {
+      std::cerr << "invalid binary model " << model_path << std::endl;
+      return -1;
+    }
+  } else {
+    gbdt.Load(std::string(model.Data(), model.Size()));
+  }
+
+  std::string output;
+  opt.Get("output", &output);
+  if (output.empty()) {
+    output = model_path + ".cpp";
+  }
+  std::string function;
+  opt.Get("function", &function);
+
+  std::ofstream source(output.c_str());
+  source << gbdt.Compile(function);
+  source.close();
+  if (!source) {
+    std::cerr << "failed to write " << output << std::endl;
+    return -1;
+  }
+  std::cout << "model compiled to " << output << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include "gbdt.hpp"
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <dlfcn.h>
+
+#include "loss.hpp"
+
+using namespace gbdt;
+
+typedef double (*PredictFn)(const double *features);
+
+// Build the source of a compiled model into a shared library, load it
+// and check that it predicts exactly as the model.
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  Configure conf;
+  conf.number_of_feature = 3;
+  conf.max_depth = 5;
+  conf.iterations = 10;
+  conf.shrinkage = 0.1;
+  conf.loss.reset(LossFactory::GetInstance()->Create("SquaredError"));
+
+  DataVector d;
+  bool r = LoadDataFromFile("../../data/train.txt",
+                            &d,
+                            conf.number_of_feature,
+                            false);
+  assert(r);
+
+  // make some values unknown, so that UNKNOWN children are grown
+  std::srand(0);
+  for (size_t i = 0; i < d.size(); ++i) {
+    if (std::rand() % 5 == 0) {
+      d[i]->feature[std::rand() % conf.number_of_feature] = kUnknownValue;
+    }
+  }
+
+  GBDT gbdt(conf);
+  gbdt.Fit(&d);
+
+  // the compiler works on saved models
+  GBDT loaded(conf);
+  loaded.Load(gbdt.Save());
+
+  {
+    std::ofstream source("compiled_model.cpp");
+    source << loaded.Compile("predict");
+  }
+
+  const char *cxx = std::getenv("CXX");
+  std::string cmd = std::string(cxx? cxx : "c++") +
+      " -O2 -shared -fPIC -o compiled_model.so compiled_model.cpp";
+  int status = std::system(cmd.c_str());
+  assert(status == 0);
+  UNUSED(status);
+
+  void *handle = dlopen("./compiled_model.so", RTLD_NOW);
+  assert(handle);
+  PredictFn predict = (PredictFn) dlsym(handle, "predict");
+  assert(predict);
+
+  for (size_t i = 0; i < d.size(); ++i) {
+    assert(predict(d[i]->feature) == loaded.Predict(*d[i]));
+  }
+
+  dlclose(handle);
+
+  // non-finite values are written as literals which compile
+  std::string model = loaded.Save();
+  size_t bias_begin = model.find("\n;\n") + 3;
+  size_t bias_end = model.find("\n;\n", bias_begin);
+  model.replace(bias_begin, bias_end - bias_begin, "-inf");
+  GBDT infinite(conf);
+  infinite.Load(model);
+  {
+    std::ofstream source("compiled_model.cpp");
+    source << infinite.Compile("predict");
+  }
+  status = std::system(cmd.c_str());
+  assert(status == 0);
+  handle = dlopen("./compiled_model.so", RTLD_NOW);
+  assert(handle);
+  predict = (PredictFn) dlsym(handle, "predict");
+  assert(predict && predict(d[0]->feature) == infinite.Predict(*d[0]));
+  dlclose(handle);
+
+  std::remove("compiled_model.cpp");
+  std::remove("compiled_model.so");
+
+  // a binary model, without trees, compiles to the same source
+  std::string binary = gbdt.SaveBinary();
+  GBDT mapped(conf);
+  r = mapped.LoadBinary(binary.data(), binary.size());
+  assert(r && mapped.Compile("predict") == gbdt.Compile("predict"));
+
+  std::cout << "compiled model ok" << std::endl;
+
+  CleanDataVector(&d);
+  return 0;
+}
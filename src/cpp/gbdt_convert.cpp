@@ -0,0 +1,77 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "dataset.hpp"
+#include <iostream>
+
+#include "time.hpp"
+#include "cmd_option.hpp"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace gbdt;
+
+// Convert a text data file to the binary format of `Dataset', which
+// `gbdt_train' loads with `binary_train_file'. With `histogram', the
+// data is binned once here, and trainings on it skip binning too.
+int main(int argc, char *argv[]) {
+  CmdOption opt;
+  opt.AddOption("threads", "t", "threads", 4);
+  opt.AddOption("input", "i", "input", OptionType::STRING, true);
+  opt.AddOption("output", "o", "output", OptionType::STRING, true);
+  opt.AddOption("feature_size", "f", "feature_size", OptionType::INT, true);
+  opt.AddOption("classification", "c", "classification", false);
+  opt.AddOption("initial_guess", "g", "initial_guess", false);
+  opt.AddOption("ignore_weight", "w", "ignore_weight", false);
+  opt.AddOption("histogram", "H", "histogram", false);
+  opt.AddOption("max_bins", "B", "max_bins", 255);
+  opt.AddOption("feature_bundling", "E", "feature_bundling", false);
+
+  if (!opt.ParseOptions(argc, argv)) {
+    opt.Help();
+    return -1;
+  }
+
+#ifdef USE_OPENMP
+  int threads_wanted;
+  opt.Get("threads", &threads_wanted);
+  omp_set_num_threads(threads_wanted);
+#endif
+
+  std::string input;
+  opt.Get("input", &input);
+  std::string output;
+  opt.Get("output", &output);
+  int number_of_feature;
+  opt.Get("feature_size", &number_of_feature);
+  bool classification, initial_guess, ignore_weight;
+  opt.Get("classification", &classification);
+  opt.Get("initial_guess", &initial_guess);
+  opt.Get("ignore_weight", &ignore_weight);
+  bool histogram, feature_bundling;
+  int max_bins;
+  opt.Get("histogram", &histogram);
+  opt.Get("max_bins", &max_bins);
+  opt.Get("feature_bundling", &feature_bundling);
+
+  Elapsed elapsed;
+  Dataset d;
+  if (!LoadDataFromFile(input, &d, number_of_feature,
+                        classification, initial_guess, ignore_weight)) {
+    std::cerr << "failed to load " << input << std::endl;
+    return -1;
+  }
+  if (histogram) {
+    d.Quantize(max_bins, feature_bundling);
+  }
+  if (!d.SaveBinary(output)) {
+    std::cerr << "failed to save " << output << std::endl;
+    return -1;
+  }
+
+  std::cout << d.Size() << " rows converted to " << output
+            << (d.IsQuantized()? " (binned)" : "") << " in "
+            << elapsed.Tell().ToMilliseconds() << " milliseconds" << std::endl;
+  return 0;
+}
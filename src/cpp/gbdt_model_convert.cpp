@@ -0,0 +1,55 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "gbdt.hpp"
+#include <fstream>
+#include <cassert>
+#include <iostream>
+#include <limits>
+
+#include "cmd_option.hpp"
+
+using namespace gbdt;
+
+// Convert a text model saved by `gbdt_train' to a binary model, which
+// `gbdt_predict' maps in place, or a binary model back to text.
+int main(int argc, char *argv[]) {
+  CmdOption opt;
+  opt.AddOption("input", "i", "input", OptionType::STRING, true);
+  opt.AddOption("output", "o", "output", OptionType::STRING, true);
+
+  if (!opt.ParseOptions(argc, argv)) {
+    opt.Help();
+    return -1;
+  }
+
+  std::string input;
+  opt.Get("input", &input);
+  std::string output;
+  opt.Get("output", &output);
+
+  MappedFile model;
+  if (!model.Open(input)) {
+    std::cerr << "failed to open " << input << std::endl;
+    return -1;
+  }
+
+  // models are only converted, split features are not bounded by rows
+  Configure conf;
+  conf.number_of_feature = std::numeric_limits<int>::max();
+  GBDT gbdt(conf);
+  std::ofstream stream(output.c_str(), std::ios::binary);
+  if (GBDT::IsBinaryModel(model.Data(), model.Size())) {
+    if (!gbdt.LoadBinary(model.Data(), model.Size())) {
+      std::cerr << "invalid binary model " << input << std::endl;
+      return -1;
+    }
+    stream << gbdt.Save();
+    std::cout << "binary model converted to text: " << output << std::endl;
+  } else {
+    gbdt.Load(std::string(model.Data(), model.Size()));
+    stream << gbdt.SaveBinary();
+    std::cout << "text model converted to binary: " << output << std::endl;
+  }
+
+  return 0;
+}
@@ -10,9 +10,79 @@
 #include "cmd_option.hpp"
 #include "loss.hpp"
 #include "metrics.hpp"
+#include "predict_pipeline.hpp"
+#include "output_buffer.hpp"
 
 using namespace gbdt;
 
+namespace {
+// Formats of the `.predict' file:
+//   full: separator line, then the score and the input row
+//   score: the score
+//   id_score: the row number, starting from 0, and the score
+//   binary: the scores as float32 in host byte order
+enum OutputFormat {FULL, SCORE, ID_SCORE, BINARY};
+
+bool ParseOutputFormat(const std::string &s, OutputFormat *format) {
+  if (s == "full") {
+    *format = FULL;
+  } else if (s == "score") {
+    *format = SCORE;
+  } else if (s == "id_score") {
+    *format = ID_SCORE;
+  } else if (s == "binary") {
+    *format = BINARY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Write predictions to the `.predict' file, and accumulate the metric.
+class PredictionWriter : public BatchWriter {
+ public:
+  PredictionWriter(OutputBuffer *output, OutputFormat format,
+                   int number_of_feature, MetricAccumulator *metric):
+      output(output), format(format),
+      number_of_feature(number_of_feature), metric(metric) {}
+
+  void Write(const ScoredBatch &batch) {
+    for (size_t i = 0; i < batch.rows.size(); ++i) {
+      const Tuple &t = *batch.rows[i];
+      ValueType score = batch.scores[i];
+      if (format == FULL) {
+        // score as `std::ostream' prints it by default
+        char s[32];
+        int n = std::snprintf(s, sizeof(s), "%g", score);
+        output->Append("--------------------------\n");
+        output->Append(s, n);
+        output->Append(' ');
+        output->Append(t.ToString(number_of_feature));
+        output->Append('\n');
+      } else if (format == SCORE) {
+        output->AppendValue(score);
+        output->Append('\n');
+      } else if (format == ID_SCORE) {
+        output->AppendInteger(batch.first_row + i);
+        output->Append(' ');
+        output->AppendValue(score);
+        output->Append('\n');
+      } else {
+        float f = static_cast<float>(score);
+        output->Append(reinterpret_cast<const char *>(&f), sizeof(f));
+      }
+      metric->Add(t.label, t.weight, score);
+    }
+  }
+
+ private:
+  OutputBuffer *output;
+  OutputFormat format;
+  int number_of_feature;
+  MetricAccumulator *metric;
+};
+}
+
 int main(int argc, char *argv[]) {
   CmdOption opt;
   opt.AddOption("model", "m", "model", "");
@@ -20,14 +90,44 @@ int main(int argc, char *argv[]) {
   opt.AddOption("input", "i", "input", "");
   opt.AddOption("metric", "t", "metric", "");
   opt.AddOption("classification", "c", "classification", false);
+  opt.AddOption("quick_scorer", "q", "quick_scorer", false);
+  // keep only known features of each row, for wide sparse inputs
+  opt.AddOption("sparse", "p", "sparse", false);
+  // streaming mode: rows are read, scored and written in batches
+  opt.AddOption("streaming", "S", "streaming", false);
+  opt.AddOption("threads", "T", "threads", 4);
+  opt.AddOption("queue_depth", "Q", "queue_depth", 8);
+  opt.AddOption("batch_size", "b", "batch_size", 10000);
+  // full, score, id_score or binary
+  opt.AddOption("output_format", "o", "output_format", "full");
 
   if (!opt.ParseOptions(argc, argv)) {
     opt.Help();
     return -1;
   }
 
+  std::string format_name;
+  opt.Get("output_format", &format_name);
+  OutputFormat output_format;
+  if (!ParseOutputFormat(format_name, &output_format)) {
+    opt.Help();
+    return -1;
+  }
+  int threads, queue_depth, batch_size;
+  opt.Get("threads", &threads);
+  opt.Get("queue_depth", &queue_depth);
+  opt.Get("batch_size", &batch_size);
+  if (threads < 1 || queue_depth < 1 || batch_size < 1) {
+    std::cerr << "threads, queue_depth and batch_size must be at least 1" << std::endl;
+    return -1;
+  }
+
   Configure conf;
   opt.Get("feature_size", &conf.number_of_feature);
+  opt.Get("quick_scorer", &conf.enable_quick_scorer);
+  bool sparse;
+  opt.Get("sparse", &sparse);
+  conf.enable_sparse_input = sparse;
   std::cout << conf.ToString() << std::endl;
   bool classification;
   opt.Get("classification", &classification);
@@ -35,52 +135,67 @@ int main(int argc, char *argv[]) {
 
   std::string model_path;
   opt.Get("model", &model_path);
-  std::string model;
-  std::ifstream stream(model_path);
-  assert(stream);
-
-  stream.seekg(0, std::ios::end);
-  model.reserve(stream.tellg());
-  stream.seekg(0, std::ios::beg);
-  model.assign(std::istreambuf_iterator<char>(stream),
-               std::istreambuf_iterator<char>());
-
-  gbdt.Load(model);
+  // a binary model is used in place, so the mapping lives as long as
+  // `gbdt'
+  MappedFile model_file;
+  bool r = model_file.Open(model_path);
+  assert(r);
+  if (GBDT::IsBinaryModel(model_file.Data(), model_file.Size())) {
+    if (!gbdt.LoadBinary(model_file.Data(), model_file.Size())) {
+      std::cerr << "invalid binary model " << model_path
+                << " for " << conf.number_of_feature << " features" << std::endl;
+      return -1;
+    }
+  } else {
+    gbdt.Load(std::string(model_file.Data(), model_file.Size()));
+  }
+  UNUSED(r);
 
-  DataVector d;
   std::string input_file;
   opt.Get("input", &input_file);
-  LoadDataFromFile(input_file,
-                   &d,
-                   conf.number_of_feature,
-                   classification);
 
   std::string metric;
   opt.Get("metric", &metric);
+  MetricAccumulator accumulator(metric);
 
   std::string predict_file = input_file + ".predict";
-  std::ofstream predict_output(predict_file.c_str());
-  PredictVector pv;
-
-  for (auto iter = d.begin() ; iter != d.end(); ++iter) {
-    ValueType p = gbdt.Predict(**iter);
-
-    predict_output << "--------------------------" << std::endl
-                   << p << " " << (*iter)->ToString(conf.number_of_feature) << std::endl;
-    pv.push_back(p);
+  OutputBuffer predict_output;
+  r = predict_output.Open(predict_file);
+  assert(r);
+  PredictionWriter writer(&predict_output, output_format, conf.number_of_feature, &accumulator);
+
+  bool streaming;
+  opt.Get("streaming", &streaming);
+  if (streaming) {
+    PredictPipeline pipeline(gbdt, conf.number_of_feature, classification);
+    pipeline.SetWorkers(threads);
+    pipeline.SetQueueDepth(queue_depth);
+    pipeline.SetBatchSize(batch_size);
+    pipeline.SetSparse(sparse);
+    pipeline.Run(input_file, &writer);
+  } else {
+    ScoredBatch batch;
+    batch.first_row = 0;
+    LoadDataFromFile(input_file,
+                     &batch.rows,
+                     conf.number_of_feature,
+                     classification,
+                     false,
+                     false,
+                     sparse);
+    batch.scores.resize(batch.rows.size());
+    if (!batch.rows.empty()) {
+      gbdt.PredictBatch(&batch.rows[0], batch.rows.size(), &batch.scores[0]);
+    }
+    writer.Write(batch);
+    CleanDataVector(&batch.rows);
   }
 
-  if (metric == "auc") {
-    std::cout << metric << ": " << Metrics::AucScore(d, pv, d.size()) << std::endl;
-  } else if (metric == "logloss") {
-    std::cout << metric << ": " << Metrics::LogLoss(d, pv, d.size()) << std::endl;
-  } else if (metric == "mse") {
-    std::cout << metric << ": " << Metrics::MeanSquaredError(d, pv, d.size()) << std::endl;
-  } else if (metric == "mae") {
-    std::cout << metric << ": " << Metrics::MeanAbsoluteError(d, pv, d.size()) << std::endl;
+  predict_output.Close();
+
+  if (MetricAccumulator::IsSupported(metric)) {
+    std::cout << metric << ": " << accumulator.Result() << std::endl;
   }
 
-  CleanDataVector(&d);
-  FreeVector(&d);
   return 0;
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <algorithm>
 #include "time.hpp"
 #include "cmd_option.hpp"
 #include "loss.hpp"
@@ -19,15 +20,26 @@ int main(int argc, char *argv[]) {
   opt.AddOption("threads", "t", "threads", 4);
   opt.AddOption("feature_size", "f", "feature_size", OptionType::INT, true);
   opt.AddOption("max_depth", "d", "max_depth", 4);
+  opt.AddOption("max_leaves", "L", "max_leaves", 0);
   opt.AddOption("iterations", "n", "iterations", 10);
   opt.AddOption("shrinkage", "s", "shrinkage", 0.1);
   opt.AddOption("feature_ratio", "r", "feature_ratio", 1.0);
   opt.AddOption("data_ratio", "R", "data_ratio", 1.0);
+  opt.AddOption("goss", "g", "goss", false);
+  opt.AddOption("goss_top_ratio", "a", "goss_top_ratio", 0.2);
+  opt.AddOption("goss_other_ratio", "b", "goss_other_ratio", 0.1);
   opt.AddOption("debug", "D", "debug", false);
   opt.AddOption("min_leaf_size", "S", "min_leaf_size", 0);
   opt.AddOption("loss", "l", "loss", "SquaredError");
-  opt.AddOption("train_file", "F", "train_file", OptionType::STRING, true);
+  opt.AddOption("newton", "N", "newton", false);
+  opt.AddOption("l2_regularization", "q", "l2_regularization", 1.0);
+  opt.AddOption("train_file", "F", "train_file", "");
+  opt.AddOption("binary_train_file", "z", "binary_train_file", "");
+  opt.AddOption("save_binary", "w", "save_binary", "");
   opt.AddOption("custom_loss_so", "c", "custom_loss_so", "");
+  opt.AddOption("histogram", "H", "histogram", false);
+  opt.AddOption("max_bins", "B", "max_bins", 255);
+  opt.AddOption("feature_bundling", "E", "feature_bundling", false);
 
   if (!opt.ParseOptions(argc, argv)) {
     opt.Help();
@@ -44,12 +56,21 @@ int main(int argc, char *argv[]) {
   Configure conf;
   opt.Get("feature_size", &conf.number_of_feature);
   opt.Get("max_depth", &conf.max_depth);
+  opt.Get("max_leaves", &conf.max_leaves);
   opt.Get("iterations", &conf.iterations);
   opt.Get("shrinkage", &conf.shrinkage);
   opt.Get("feature_ratio", &conf.feature_sample_ratio);
   opt.Get("data_ratio", &conf.data_sample_ratio);
+  opt.Get("goss", &conf.enable_goss);
+  opt.Get("goss_top_ratio", &conf.goss_top_ratio);
+  opt.Get("goss_other_ratio", &conf.goss_other_ratio);
   opt.Get("debug", &conf.debug);
   opt.Get("min_leaf_size", &conf.min_leaf_size);
+  opt.Get("newton", &conf.enable_newton);
+  opt.Get("l2_regularization", &conf.l2_regularization);
+  opt.Get("histogram", &conf.enable_histogram);
+  opt.Get("max_bins", &conf.max_bins);
+  opt.Get("feature_bundling", &conf.enable_feature_bundling);
   std::string loss_type;
   opt.Get("loss", &loss_type);
   std::string custom_loss_so;
@@ -64,25 +85,71 @@ int main(int argc, char *argv[]) {
 
   conf.loss.reset(objective);
 
+  std::string error;
+  if (!conf.Validate(&error)) {
+    std::cerr << "invalid configure: " << error << std::endl;
+    return -1;
+  }
+
   std::cout << conf.ToString() << std::endl;
 
   std::string train_file;
   opt.Get("train_file", &train_file);
+  std::string binary_train_file;
+  opt.Get("binary_train_file", &binary_train_file);
+  std::string save_binary;
+  opt.Get("save_binary", &save_binary);
+  if (train_file.empty() == binary_train_file.empty()) {
+    std::cerr << "exactly one of train_file and binary_train_file is required" << std::endl;
+    opt.Help();
+    return -1;
+  }
 
-  DataVector d;
-  bool r = LoadDataFromFile(train_file,
-                            &d,
-                            conf.number_of_feature,
-                            loss_type == "LogLoss");
-  assert(r);
+  Dataset d;
+  Elapsed loading;
+  if (!binary_train_file.empty()) {
+    if (!d.LoadBinary(binary_train_file) ||
+        d.NumberOfFeature() != conf.number_of_feature) {
+      std::cerr << "failed to load binary data: " << binary_train_file << std::endl;
+      return -1;
+    }
+    if (d.TwoClassLabels() != (loss_type == "LogLoss")) {
+      std::cerr << "labels of binary data " << binary_train_file
+                << (d.TwoClassLabels()? " are" : " are not")
+                << " converted for classification, unlike loss " << loss_type << std::endl;
+      return -1;
+    }
+    train_file = binary_train_file;
+  } else {
+    bool r = LoadDataFromFile(train_file,
+                              &d,
+                              conf.number_of_feature,
+                              loss_type == "LogLoss");
+    assert(r);
+    UNUSED(r);
+  }
+  long loading_time = loading.Tell().ToMilliseconds();
+  std::ifstream train_stream(train_file.c_str(), std::ios::binary | std::ios::ate);
+  double megabytes = static_cast<double>(train_stream.tellg()) / (1024 * 1024);
+  std::cout << "loading time: " << loading_time << " milliseconds, "
+            << megabytes / static_cast<double>(std::max(loading_time, 1L)) * 1000 << " MB/s" << std::endl;
+
+  if (!save_binary.empty()) {
+    // binned once here, later runs skip both parsing and binning
+    if (conf.enable_histogram && !d.IsQuantized()) {
+      d.Quantize(conf.max_bins, conf.enable_feature_bundling);
+    }
+    if (!d.SaveBinary(save_binary)) {
+      std::cerr << "failed to save binary data: " << save_binary << std::endl;
+      return -1;
+    }
+  }
 
   GBDT gbdt(conf);
 
   Elapsed elapsed;
   gbdt.Fit(&d);
   std::cout << "training time: " << elapsed.Tell().ToMilliseconds() << " milliseconds" << std::endl;
-  CleanDataVector(&d);
-  FreeVector(&d);
 
   std::string model_file = train_file + ".model";
   std::ofstream model_output(model_file.c_str());
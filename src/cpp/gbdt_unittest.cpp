@@ -0,0 +1,76 @@
+#include "gbdt.hpp"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace gbdt;
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+  const size_t n = 100;
+  const double a = 0.2, b = 0.1;
+  const size_t top = static_cast<size_t>(n * a);
+  const size_t samples = top + static_cast<size_t>(n * b);
+
+  Dataset d;
+  d.Reset(n, 1);
+  for (size_t i = 0; i < n; ++i) {
+    // rows with larger index have larger gradients, of either sign
+    d.target[i] = (i % 2 == 0? 1.0 : -1.0) * static_cast<ValueType>(i);
+  }
+
+  std::vector<bool> sampled(n, false);
+  std::vector<size_t> rows(n);
+  for (int round = 0; round < 100; ++round) {
+    for (size_t i = 0; i < n; ++i) {
+      rows[i] = i;
+      d.weight[i] = 1;
+    }
+    SampleByGradient(&d, &rows[0], top, samples);
+
+    std::vector<bool> seen(n, false);
+    for (size_t j = 0; j < n; ++j) {
+      assert(!seen[rows[j]]);
+      seen[rows[j]] = true;
+    }
+    // the rows of the top gradients are always kept, as they are
+    for (size_t j = 0; j < top; ++j) {
+      assert(rows[j] >= n - top);
+      assert(d.weight[rows[j]] == 1);
+    }
+    // the others are sampled from the rest, scaled by (1-a)/b
+    for (size_t j = top; j < samples; ++j) {
+      assert(rows[j] < n - top);
+      assert(std::fabs(d.weight[rows[j]] - (1 - a) / b) < 1e-9);
+      sampled[rows[j]] = true;
+    }
+    for (size_t j = samples; j < n; ++j) {
+      assert(d.weight[rows[j]] == 1);
+    }
+  }
+  for (size_t i = 0; i < n - top; ++i) {
+    assert(sampled[i]);
+  }
+
+  Configure conf;
+  std::string error;
+  conf.enable_goss = true;
+  conf.goss_top_ratio = a;
+  conf.goss_other_ratio = b;
+  assert(conf.Validate(&error));
+  conf.goss_top_ratio = 0;
+  assert(!conf.Validate(&error));
+  conf.goss_top_ratio = 1.5;
+  assert(!conf.Validate(&error));
+  conf.goss_top_ratio = 0.6;
+  conf.goss_other_ratio = 0.5;
+  assert(!conf.Validate(&error));
+  conf.enable_goss = false;
+  assert(conf.Validate(&error));
+
+  std::cout << "goss ok" << std::endl;
+  return 0;
+}
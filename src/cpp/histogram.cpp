@@ -0,0 +1,336 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "histogram.hpp"
+#include "dataset.hpp"
+#include "math_util.hpp"
+#include "quantile_sketch.hpp"
+#include <algorithm>
+#include <cassert>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+template <typename T>
+void BuildAux(const gbdt::Dataset &data, const T *column,
+              const size_t *rows, size_t len,
+              const gbdt::ValueType *cover, gbdt::HistogramBin *h) {
+  const gbdt::ValueType *target = &data.target[0];
+  const gbdt::ValueType *weight = &data.weight[0];
+  for (size_t i = 0; i < len; ++i) {
+    size_t r = rows[i];
+    gbdt::HistogramBin &b = h[column[r]];
+    b.s += target[r] * weight[r];
+    b.ss += gbdt::Squared(target[r]) * weight[r];
+    b.c += cover[r];
+    b.n++;
+  }
+}
+
+void BuildCodes(const gbdt::Dataset &data, const size_t *rows, size_t len,
+                int g, const gbdt::ValueType *cover, gbdt::HistogramBin *h) {
+  if (!cover) {
+    cover = &data.weight[0];
+  }
+  if (data.BinWidth() == 1) {
+    BuildAux(data, data.BinColumn8(g), rows, len, cover, h);
+  } else {
+    BuildAux(data, data.BinColumn16(g), rows, len, cover, h);
+  }
+}
+
+void Add(const gbdt::HistogramBin &x, gbdt::HistogramBin *b) {
+  b->s += x.s;
+  b->ss += x.ss;
+  b->c += x.c;
+  b->n += x.n;
+}
+
+void Subtract(const gbdt::HistogramBin &x, gbdt::HistogramBin *b) {
+  b->s -= x.s;
+  b->ss -= x.ss;
+  b->c -= x.c;
+  b->n -= x.n;
+}
+
+// minimum rows of a block of `Histogram::BuildRows' in `Build', below
+// which summing up the private histograms does not pay off
+const size_t kMinRowsPerThread = 4096;
+
+int Threads() {
+#ifdef USE_OPENMP
+  return omp_in_parallel()? 1 : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// entries of a sketch per bin of `BinMapper::Fit'
+const size_t kSketchSizePerBin = 8;
+
+void AddValues(const gbdt::Dataset &d, int f, size_t begin, size_t end,
+               gbdt::QuantileSketch *sketch) {
+  const gbdt::ValueType *column = d.Column(f);
+  const gbdt::ValueType *weight = &d.weight[0];
+  for (size_t i = begin; i < end; ++i) {
+    if (column[i] != gbdt::kUnknownValue) {
+      sketch->Add(column[i], std::max<gbdt::ValueType>(weight[i], 0));
+    }
+  }
+}
+
+// At most `max_bins' bins, between distinct values while there are
+// few enough of them, at weighted quantiles otherwise.
+void CutAtQuantiles(gbdt::QuantileSketch *sketch, int max_bins,
+                    std::vector<gbdt::ValueType> *b) {
+  const std::vector<gbdt::QuantileSketch::Entry> &summary = sketch->Summary();
+
+  // distinct values and the weight up to them, values which are
+  // almost equal are never splitted, the same as
+  // `RegressionTree::GetImpurity'
+  std::vector<gbdt::ValueType> distinct;
+  std::vector<double> acc;
+  for (size_t i = 0; i < summary.size(); ++i) {
+    if (distinct.empty() || !gbdt::AlmostEqual(distinct.back(), summary[i].value)) {
+      distinct.push_back(summary[i].value);
+      acc.push_back(0);
+    }
+    // the middle of the rank bounds, exact for an exact summary
+    acc.back() = (summary[i].rmin + summary[i].rmax + summary[i].w) / 2;
+  }
+
+  if (distinct.size() <= static_cast<size_t>(max_bins)) {
+    for (size_t i = 0; i + 1 < distinct.size(); ++i) {
+      b->push_back((distinct[i] + distinct[i+1]) / 2);
+    }
+    return;
+  }
+  double total = summary.back().rmax;
+  if (!(total > 0)) {
+    // no weight to cut
+    return;
+  }
+
+  double step = total / max_bins;
+  double next = step;
+  for (size_t i = 0; i + 1 < distinct.size(); ++i) {
+    if (acc[i] >= next && b->size() + 1 < static_cast<size_t>(max_bins)) {
+      b->push_back((distinct[i] + distinct[i+1]) / 2);
+      while (next <= acc[i]) next += step;
+    }
+  }
+}
+
+}
+
+namespace gbdt {
+
+void BinMapper::Fit(const Dataset &d, int max_bins) {
+  assert(max_bins > 1 && max_bins < std::numeric_limits<BinType>::max());
+
+  number_of_feature = d.NumberOfFeature();
+  bounds.assign(number_of_feature, std::vector<ValueType>());
+
+  // One pass over the values, sketches are exact below `sketch_size'
+  // distinct values. With fewer features than threads, the rows of
+  // each feature are split into parts, sketched in parallel and merged.
+  size_t sketch_size = kSketchSizePerBin * static_cast<size_t>(max_bins);
+  size_t n = d.Size();
+  int parts = std::max(1, std::min<int>(Threads() / std::max(number_of_feature, 1),
+                                        static_cast<int>(n / kMinRowsPerThread)));
+  if (parts == 1) {
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int f = 0; f < number_of_feature; ++f) {
+      QuantileSketch sketch(sketch_size);
+      AddValues(d, f, 0, n, &sketch);
+      CutAtQuantiles(&sketch, max_bins, &bounds[f]);
+    }
+    ComputeOffsets();
+    return;
+  }
+
+  std::vector<QuantileSketch> sketches(number_of_feature * parts,
+                                       QuantileSketch(sketch_size));
+  int tasks = number_of_feature * parts;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int t = 0; t < tasks; ++t) {
+    int k = t % parts;
+    AddValues(d, t / parts, n * k / parts, n * (k + 1) / parts, &sketches[t]);
+  }
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+  for (int f = 0; f < number_of_feature; ++f) {
+    QuantileSketch &sketch = sketches[f * parts];
+    for (int k = 1; k < parts; ++k) {
+      sketch.Merge(sketches[f * parts + k]);
+    }
+    CutAtQuantiles(&sketch, max_bins, &bounds[f]);
+  }
+  ComputeOffsets();
+}
+
+void BinMapper::SetBounds(const std::vector<std::vector<ValueType> > &b) {
+  number_of_feature = static_cast<int>(b.size());
+  bounds = b;
+  ComputeOffsets();
+}
+
+void BinMapper::ComputeOffsets() {
+  offsets.resize(number_of_feature);
+  total_bins = 0;
+  for (int f = 0; f < number_of_feature; ++f) {
+    offsets[f] = total_bins;
+    total_bins += NumBins(f);
+  }
+}
+
+BinType BinMapper::ValueToBin(int f, ValueType v) const {
+  if (v == kUnknownValue) {
+    return 0;
+  }
+  const std::vector<ValueType> &b = bounds[f];
+  return static_cast<BinType>(
+      std::upper_bound(b.begin(), b.end(), v) - b.begin() + 1);
+}
+
+Histogram::Histogram(const Dataset &data, const ValueType *cover):
+    data(data), cover(cover), smallest(0) {
+  int n = data.NumberOfBinColumns();
+  offsets.resize(n);
+  size_t total = 0;
+  for (int g = 0; g < n; ++g) {
+    offsets[g] = total;
+    total += data.ColumnBins(g);
+    if (data.ColumnBins(g) < data.ColumnBins(smallest)) {
+      smallest = g;
+    }
+  }
+  bins.resize(total);
+}
+
+void Histogram::Build(const Dataset &data, const size_t *rows, size_t len, int g) {
+  HistogramBin *h = &bins[offsets[g]];
+  std::fill(h, h + data.ColumnBins(g), HistogramBin());
+  BuildCodes(data, rows, len, g, cover, h);
+}
+
+void Histogram::Build(const Dataset &data, const size_t *rows, size_t len) {
+  if (RowWise(data, len)) {
+    BuildRows(data, rows, len, Threads());
+    return;
+  }
+
+  int n = data.NumberOfBinColumns();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int g = 0; g < n; ++g) {
+    Build(data, rows, len, g);
+  }
+}
+
+void Histogram::BuildRows(const Dataset &data, const size_t *rows, size_t len, int blocks) {
+  assert(blocks > 0);
+  int n = data.NumberOfBinColumns();
+  size_t total = bins.size();
+  std::vector<HistogramBin> local(total * blocks);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+  for (int k = 0; k < blocks; ++k) {
+    size_t begin = len * k / blocks;
+    size_t end = len * (k + 1) / blocks;
+    for (int g = 0; g < n; ++g) {
+      BuildCodes(data, rows + begin, end - begin, g, cover, &local[total * k + offsets[g]]);
+    }
+  }
+
+  // blocks are summed up in order, so the result only depends on `blocks'
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+  for (size_t i = 0; i < total; ++i) {
+    HistogramBin b = local[i];
+    for (int k = 1; k < blocks; ++k) {
+      Add(local[total * k + i], &b);
+    }
+    bins[i] = b;
+  }
+}
+
+bool Histogram::RowWise(const Dataset &data, size_t len) const {
+  int threads = Threads();
+  return threads > data.NumberOfBinColumns() && len >= kMinRowsPerThread * threads;
+}
+
+void Histogram::Subtract(const Histogram &other) {
+  assert(bins.size() == other.bins.size());
+  for (size_t i = 0; i < bins.size(); ++i) {
+    bins[i].s -= other.bins[i].s;
+    bins[i].ss -= other.bins[i].ss;
+    bins[i].c -= other.bins[i].c;
+    bins[i].n -= other.bins[i].n;
+  }
+}
+
+const HistogramBin *Histogram::Feature(int f) const {
+  return &bins[offsets[data.ColumnOf(f)] + data.BinStart(f)];
+}
+
+size_t Histogram::NumBins(int f) const {
+  return data.GetBinMapper().NumBins(f);
+}
+
+HistogramBin Histogram::Total() const {
+  HistogramBin total = HistogramBin();
+  const HistogramBin *h = &bins[offsets[smallest]];
+  for (size_t b = 0; b < data.ColumnBins(smallest); ++b) {
+    Add(h[b], &total);
+  }
+  return total;
+}
+
+HistogramBin Histogram::Unknown(int f, const HistogramBin &total) const {
+  const HistogramBin *h = Feature(f);
+  if (data.ColumnFeatures(data.ColumnOf(f)).size() == 1) {
+    return h[0];
+  }
+  HistogramBin unknown = total;
+  for (size_t b = 1; b < NumBins(f); ++b) {
+    ::Subtract(h[b], &unknown);
+  }
+  return unknown;
+}
+
+HistogramPool::~HistogramPool() {
+  for (size_t i = 0; i < all.size(); ++i) {
+    delete all[i];
+  }
+}
+
+Histogram *HistogramPool::Acquire() {
+  if (available.empty()) {
+    Histogram *hist = new Histogram(data, cover);
+    all.push_back(hist);
+    return hist;
+  }
+  Histogram *hist = available.back();
+  available.pop_back();
+  return hist;
+}
+
+void HistogramPool::Release(Histogram *hist) {
+  if (hist) {
+    available.push_back(hist);
+  }
+}
+
+}
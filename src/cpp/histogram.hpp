@@ -0,0 +1,137 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+#include <vector>
+#include "data.hpp"
+
+namespace gbdt {
+
+class Dataset;
+
+// Maps feature values to bin indices. Each feature is discretized once
+// before training, so that split finding only has to scan bins
+// instead of sorting tuples at every node.
+//
+// Bin 0 is reserved for `kUnknownValue'. Known values of feature `f'
+// fall into bins [1, NumBins(f)), bin `b' covers values in
+// [UpperBound(f, b-1), UpperBound(f, b)).
+class BinMapper {
+ public:
+  BinMapper(): number_of_feature(0), total_bins(0) {}
+
+  // Compute bin boundaries from raw feature values of `d'. At most
+  // `max_bins' bins are used for known values of each feature.
+  void Fit(const Dataset &d, int max_bins);
+  // Use the bin boundaries of each feature, e.g. `Bounds' of a mapper
+  // saved before.
+  void SetBounds(const std::vector<std::vector<ValueType> > &b);
+  const std::vector<ValueType> &Bounds(int f) const { return bounds[f]; }
+
+  BinType ValueToBin(int f, ValueType v) const;
+
+  // A value which falls into bin `b' of feature `f'.
+  ValueType BinToValue(int f, BinType b) const {
+    if (b == 0) return kUnknownValue;
+    if (b == 1) return -kValueTypeMax;
+    return bounds[f][b-2];
+  }
+
+  // Split value between bin `b' and bin `b+1' of feature `f',
+  // i.e. v < UpperBound(f, b) iff ValueToBin(f, v) <= b.
+  ValueType UpperBound(int f, BinType b) const {
+    return bounds[f][b-1];
+  }
+
+  size_t NumBins(int f) const { return bounds[f].size() + 2; }
+  size_t Offset(int f) const { return offsets[f]; }
+  size_t TotalBins() const { return total_bins; }
+  int NumberOfFeature() const { return number_of_feature; }
+
+ private:
+  void ComputeOffsets();
+
+  int number_of_feature;
+  size_t total_bins;
+  std::vector<std::vector<ValueType> > bounds;
+  std::vector<size_t> offsets;
+};
+
+struct HistogramBin {
+  double s;   // sum of weighted targets
+  double ss;  // sum of weighted squared targets
+  double c;   // sum of weights, or of the histogram's `cover'
+  size_t n;   // number of tuples
+};
+
+// Per-node statistics of all features, laid out as the bin codes of
+// the bin columns of a quantized `Dataset', so that a bundle of sparse
+// features takes one pass over rows to build and its codes once in
+// memory.
+class Histogram {
+ public:
+  // `cover[r]', e.g. the weighted hessian of row `r', is summed up in
+  // `HistogramBin::c' instead of the weight if it is not NULL.
+  Histogram(const Dataset &data, const ValueType *cover = NULL);
+
+  // Set the bins of bin column `g' of `data' to rows `rows[0, len)'.
+  void Build(const Dataset &data, const size_t *rows, size_t len, int g);
+  // Set all the bins, by rows if `RowWise', in parallel over bin
+  // columns otherwise.
+  void Build(const Dataset &data, const size_t *rows, size_t len);
+  // Set all the bins, each of `blocks' consecutive blocks of
+  // `rows' into a private histogram in parallel, then sum them up.
+  void BuildRows(const Dataset &data, const size_t *rows, size_t len, int blocks);
+  // Whether `Build' of `len' rows had better split rows than bin
+  // columns among threads: there are more threads than columns and
+  // enough rows for each thread.
+  bool RowWise(const Dataset &data, size_t len) const;
+
+  // Histogram of a sibling region can be derived as parent minus the
+  // other children, which is much cheaper than a pass over tuples.
+  void Subtract(const Histogram &other);
+
+  // Bins [1, NumBins(f)) of feature `f'. Bin 0, the rows with `f'
+  // unknown, is only stored for a feature with a bin column of its
+  // own; use `Unknown' for it.
+  const HistogramBin *Feature(int f) const;
+  size_t NumBins(int f) const;
+
+  // Sum of all the rows, taken from the bin column of fewest codes.
+  HistogramBin Total() const;
+  // Bin 0 of feature `f', given `Total'.
+  HistogramBin Unknown(int f, const HistogramBin &total) const;
+
+ private:
+  const Dataset &data;
+  const ValueType *cover;
+  std::vector<size_t> offsets;    // of the codes of each bin column
+  int smallest;                   // bin column of fewest codes
+  std::vector<HistogramBin> bins;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// Recycles histograms during tree growth, so that at most a few
+// histograms per level are alive and none is allocated per node.
+class HistogramPool {
+ public:
+  HistogramPool(const Dataset &data, const ValueType *cover = NULL):
+      data(data), cover(cover) {}
+  ~HistogramPool();
+
+  Histogram *Acquire();
+  void Release(Histogram *hist);
+
+ private:
+  const Dataset &data;
+  const ValueType *cover;
+  std::vector<Histogram *> all;
+  std::vector<Histogram *> available;
+
+  DISALLOW_COPY_AND_ASSIGN(HistogramPool);
+};
+
+}
+
+#endif /* _HISTOGRAM_H_ */
@@ -0,0 +1,162 @@
+#include "histogram.hpp"
+#include <iostream>
+#include <cassert>
+
+#include "dataset.hpp"
+#include "math_util.hpp"
+
+using namespace gbdt;
+
+// Features 0-19 are sparse and mutually exclusive, 20-23 are dense.
+static void FillSparse(Dataset *d) {
+  size_t n = 1000;
+  d->Reset(n, 24);
+  for (size_t i = 0; i < n; ++i) {
+    d->weight[i] = static_cast<ValueType>(1 + i % 3);
+    d->target[i] = static_cast<ValueType>(i % 17) - 8;
+    if (i % 4 != 0) {
+      d->Column(static_cast<int>(i % 20))[i] = static_cast<ValueType>(i % 7);
+    }
+    for (int f = 20; f < 24; ++f) {
+      d->Column(f)[i] = static_cast<ValueType>((i * f) % 11);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+  int number_of_feature = 3;
+
+  Dataset d;
+  bool r = LoadDataFromFile("../../data/train.txt",
+                            &d,
+                            number_of_feature,
+                            false);
+  assert(r);
+  d.target = d.label;
+
+  // keep a copy of raw values, they are released by quantization
+  std::vector<std::vector<ValueType> > values;
+  for (int f = 0; f < number_of_feature; ++f) {
+    values.push_back(std::vector<ValueType>(d.Column(f), d.Column(f) + d.Size()));
+  }
+
+  d.Quantize(8);
+  const BinMapper &mapper = d.GetBinMapper();
+  assert(d.BinWidth() == 1);
+  for (int f = 0; f < number_of_feature; ++f) {
+    std::cout << "feature " << f << ": " << mapper.NumBins(f) << " bins" << std::endl;
+    assert(mapper.NumBins(f) <= 9);
+  }
+
+  for (size_t i = 0; i < d.Size(); ++i) {
+    for (int f = 0; f < number_of_feature; ++f) {
+      BinType b = d.GetBin(f, i);
+      if (b < mapper.NumBins(f) - 1) {
+        assert(values[f][i] < mapper.UpperBound(f, b));
+      }
+      if (b > 1) {
+        assert(values[f][i] >= mapper.UpperBound(f, b-1));
+      }
+      assert(mapper.ValueToBin(f, d.GetValue(f, i)) == b);
+    }
+  }
+
+  // histogram of the second half derived from the whole data
+  std::vector<size_t> rows(d.Size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    rows[i] = i;
+  }
+  size_t half = d.Size() / 2;
+
+  HistogramPool pool(d);
+  Histogram *all = pool.Acquire();
+  Histogram *part = pool.Acquire();
+  Histogram *expected = pool.Acquire();
+  all->Build(d, &rows[0], rows.size());
+  part->Build(d, &rows[0], half);
+  expected->Build(d, &rows[half], rows.size() - half);
+  all->Subtract(*part);
+
+  for (int f = 0; f < number_of_feature; ++f) {
+    const HistogramBin *h1 = all->Feature(f);
+    const HistogramBin *h2 = expected->Feature(f);
+    for (size_t b = 0; b < mapper.NumBins(f); ++b) {
+      assert(h1[b].n == h2[b].n);
+      assert(AlmostEqual(h1[b].s, h2[b].s));
+      assert(AlmostEqual(h1[b].c, h2[b].c));
+    }
+  }
+
+  // rows split among blocks sum up to the same histogram
+  Histogram *by_rows = pool.Acquire();
+  by_rows->BuildRows(d, &rows[half], rows.size() - half, 7);
+  for (int f = 0; f < number_of_feature; ++f) {
+    const HistogramBin *h1 = by_rows->Feature(f);
+    const HistogramBin *h2 = expected->Feature(f);
+    for (size_t b = 0; b < mapper.NumBins(f); ++b) {
+      assert(h1[b].n == h2[b].n);
+      assert(AlmostEqual(h1[b].s, h2[b].s));
+      assert(AlmostEqual(h1[b].ss, h2[b].ss));
+      assert(AlmostEqual(h1[b].c, h2[b].c));
+    }
+  }
+  pool.Release(by_rows);
+
+  pool.Release(part);
+  assert(pool.Acquire() == part);
+
+  std::cout << "histogram subtraction ok" << std::endl;
+
+  // bundled features keep their bins and histograms
+  Dataset plain, bundled;
+  FillSparse(&plain);
+  FillSparse(&bundled);
+  plain.Quantize(16);
+  bundled.Quantize(16, true);
+  assert(plain.NumberOfBinColumns() == 24);
+  assert(bundled.NumberOfBinColumns() < 10);
+  for (size_t i = 0; i < plain.Size(); ++i) {
+    for (int f = 0; f < 24; ++f) {
+      assert(plain.GetBin(f, i) == bundled.GetBin(f, i));
+    }
+  }
+
+  std::vector<size_t> sparse_rows;
+  for (size_t i = 0; i < plain.Size(); i += 3) {
+    sparse_rows.push_back(i);
+  }
+  HistogramPool plain_pool(plain);
+  HistogramPool bundled_pool(bundled);
+  Histogram *h1 = plain_pool.Acquire();
+  Histogram *h2 = bundled_pool.Acquire();
+  h1->Build(plain, &sparse_rows[0], sparse_rows.size());
+  h2->Build(bundled, &sparse_rows[0], sparse_rows.size());
+  for (int f = 0; f < 24; ++f) {
+    for (size_t b = 1; b < h1->NumBins(f); ++b) {
+      assert(h1->Feature(f)[b].n == h2->Feature(f)[b].n);
+      assert(AlmostEqual(h1->Feature(f)[b].s, h2->Feature(f)[b].s));
+      assert(AlmostEqual(h1->Feature(f)[b].c, h2->Feature(f)[b].c));
+    }
+    // bin 0 of a bundled feature is derived from all the rows
+    HistogramBin u1 = h1->Unknown(f, h1->Total());
+    HistogramBin u2 = h2->Unknown(f, h2->Total());
+    assert(u1.n == u2.n);
+    assert(u1.n == h1->Feature(f)[0].n);
+    assert(AlmostEqual(u1.s, u2.s));
+    assert(AlmostEqual(u1.c, u2.c));
+  }
+  h2->BuildRows(bundled, &sparse_rows[0], sparse_rows.size(), 3);
+  for (int f = 0; f < 24; ++f) {
+    for (size_t b = 1; b < h1->NumBins(f); ++b) {
+      assert(h1->Feature(f)[b].n == h2->Feature(f)[b].n);
+    }
+    assert(h1->Unknown(f, h1->Total()).n == h2->Unknown(f, h2->Total()).n);
+  }
+
+  std::cout << "feature bundling: " << bundled.NumberOfBinColumns()
+            << " bin columns for 24 features" << std::endl;
+
+  return 0;
+}
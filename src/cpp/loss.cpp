@@ -1,9 +1,132 @@
 #include "loss.hpp"
 #include <dlfcn.h>
 #include <iostream>
+#include <algorithm>
+
+namespace {
+
+void CopyToTuple(const gbdt::Dataset &d, size_t row, gbdt::Tuple *t) {
+  t->label = d.label[row];
+  t->weight = d.weight[row];
+  t->target = d.target[row];
+  t->residual = d.residual[row];
+  t->initial_guess = d.initial_guess[row];
+}
+
+// rows of a block of `LogLoss' batches, gathered on the stack for
+// `VectorExp' and `VectorLog'
+const size_t kLossBlockSize = 256;
+
+}
 
 namespace gbdt {
 
+double Objective::GetBias(const Dataset &d, const size_t *rows, size_t len) const {
+  DataVector tuples(len);
+  for (size_t i = 0; i < len; ++i) {
+    tuples[i] = new Tuple();
+    CopyToTuple(d, rows[i], tuples[i]);
+  }
+  double r = GetBias(tuples, len);
+  for (size_t i = 0; i < len; ++i) {
+    delete tuples[i];
+  }
+  return r;
+}
+
+double Objective::GetLoss(const Dataset &d, size_t row, ValueType f) const {
+  Tuple t;
+  CopyToTuple(d, row, &t);
+  return GetLoss(t, f);
+}
+
+void Objective::UpdateGradient(Dataset *d, size_t row, ValueType f) const {
+  Tuple t;
+  CopyToTuple(*d, row, &t);
+  UpdateGradient(&t, f);
+  d->target[row] = t.target;
+  d->residual[row] = t.residual;
+}
+
+void Objective::UpdateGradients(Dataset *d, const size_t *rows, size_t n,
+                                const ValueType *f) const {
+  for (size_t j = 0; j < n; ++j) {
+    UpdateGradient(d, rows[j], f[rows[j]]);
+  }
+}
+
+double Objective::GetTotalLoss(const Dataset &d, const size_t *rows, size_t n,
+                               const ValueType *f) const {
+  double s = 0;
+  for (size_t j = 0; j < n; ++j) {
+    s += GetLoss(d, rows[j], f[rows[j]]);
+  }
+  return s;
+}
+
+double Objective::GetRegionPrediction(const Dataset &d, const size_t *rows, size_t len) const {
+  DataVector tuples(len);
+  for (size_t i = 0; i < len; ++i) {
+    tuples[i] = new Tuple();
+    CopyToTuple(d, rows[i], tuples[i]);
+  }
+  double r = GetRegionPrediction(tuples, len);
+  for (size_t i = 0; i < len; ++i) {
+    delete tuples[i];
+  }
+  return r;
+}
+
+void LogLoss::UpdateGradients(Dataset *d, const size_t *rows, size_t n,
+                              const ValueType *f) const {
+  const ValueType *label = &d->label[0];
+  ValueType *target = &d->target[0];
+  ValueType *hessian = &d->hessian[0];
+  double e[kLossBlockSize];
+  for (size_t begin = 0; begin < n; begin += kLossBlockSize) {
+    size_t m = std::min(kLossBlockSize, n - begin);
+    const size_t *block = rows + begin;
+    for (size_t j = 0; j < m; ++j) {
+      e[j] = 2.0 * label[block[j]] * f[block[j]];
+    }
+    VectorExp(e, m, e);
+    for (size_t j = 0; j < m; ++j) {
+      size_t r = block[j];
+      ValueType g = 2.0 * label[r] / (1 + e[j]);
+      ValueType y = Abs(g);
+      target[r] = g;
+      hessian[r] = y*(2-y);
+    }
+  }
+}
+
+double LogLoss::GetTotalLoss(const Dataset &d, const size_t *rows, size_t n,
+                             const ValueType *f) const {
+  // log(1+exp(z)) as max(z, 0) + log(1+exp(-|z|)), which neither
+  // overflows, and only takes logs in (1, 2]
+  const ValueType *label = &d.label[0];
+  double z[kLossBlockSize];
+  double e[kLossBlockSize];
+  double s = 0;
+  for (size_t begin = 0; begin < n; begin += kLossBlockSize) {
+    size_t m = std::min(kLossBlockSize, n - begin);
+    const size_t *block = rows + begin;
+    for (size_t j = 0; j < m; ++j) {
+      z[j] = -2.0 * label[block[j]] * f[block[j]];
+      e[j] = -Abs(z[j]);
+    }
+    VectorExp(e, m, e);
+    for (size_t j = 0; j < m; ++j) {
+      e[j] = 1 + e[j];
+    }
+    VectorLog(e, m, e);
+    for (size_t j = 0; j < m; ++j) {
+      s += 2.0 * (std::max(z[j], 0.0) + e[j]);
+    }
+  }
+  return s;
+}
+
 bool LossFactory::Register(const std::string &name, CreateFn creater) {
   auto r = creaters_.insert(std::make_pair(name, creater));
   return r.second;
@@ -17,6 +17,32 @@ class Objective {
   virtual void UpdateGradient(Tuple* t, ValueType f) const = 0;
   virtual double GetRegionPrediction(DataVector &d, size_t len) const = 0;
   virtual std::string GetName() const = 0;
+
+  // Columnar versions used in training, `rows' are indices into `d'.
+  // The defaults go through the tuple based interface above, so that
+  // objectives loaded from shared libraries keep working. Built-in
+  // objectives override them.
+  virtual double GetBias(const Dataset &d, const size_t *rows, size_t len) const;
+  virtual double GetLoss(const Dataset &d, size_t row, ValueType f) const;
+  virtual void UpdateGradient(Dataset *d, size_t row, ValueType f) const;
+  virtual double GetRegionPrediction(const Dataset &d, const size_t *rows, size_t len) const;
+
+  // `UpdateGradient' of rows `rows[0, n)' with predictions
+  // `f[rows[j]]'. The default goes row by row, built-in objectives
+  // override it with plain loops over the columns.
+  virtual void UpdateGradients(Dataset *d, const size_t *rows, size_t n,
+                               const ValueType *f) const;
+  // Sum of `GetLoss' of rows `rows[0, n)' with predictions `f[rows[j]]'.
+  virtual double GetTotalLoss(const Dataset &d, const size_t *rows, size_t n,
+                              const ValueType *f) const;
+
+  // Second-order objectives also store the hessian of each row in
+  // `Dataset::hessian', next to the negative gradient in `target'.
+  // With `Configure::enable_newton', trees are fitted by Newton steps
+  // on them: split gains and leaf values come from the sums of
+  // gradients and hessians, and `GetRegionPrediction' is not used.
+  virtual bool HasHessian() const { return false; }
+
   virtual ~Objective() {}
 };
 
@@ -105,6 +131,9 @@ class LossFactory {
 //
 // Optimal terminal node value (approximated):
 // rj = sum_{i \in Rj}(di) / |Rj|
+//
+// Hessian:
+// h = 1
 ///////////////////////////////////////////////////////////////////////
 
 class SquaredError: public Objective {
@@ -135,6 +164,53 @@ class SquaredError: public Objective {
   double GetRegionPrediction(DataVector &d, size_t len) const {
     return Average(d, len);
   }
+
+  double GetBias(const Dataset &d, const size_t *rows, size_t len) const {
+    double s = 0;
+    double c = 0;
+    for (size_t i = 0; i < len; ++i) {
+      s += d.label[rows[i]] * d.weight[rows[i]];
+      c += d.weight[rows[i]];
+    }
+
+    return s / c;
+  }
+
+  double GetLoss(const Dataset &d, size_t row, ValueType f) const {
+    return Squared(d.label[row]-f) * 0.5 * d.weight[row];
+  }
+
+  void UpdateGradient(Dataset *d, size_t row, ValueType f) const {
+    d->target[row] = d->label[row] - f;
+  }
+
+  double GetRegionPrediction(const Dataset &d, const size_t *rows, size_t len) const {
+    return Average(d, rows, len);
+  }
+
+  void UpdateGradients(Dataset *d, const size_t *rows, size_t n, const ValueType *f) const {
+    const ValueType *label = &d->label[0];
+    ValueType *target = &d->target[0];
+    ValueType *hessian = &d->hessian[0];
+    for (size_t j = 0; j < n; ++j) {
+      size_t r = rows[j];
+      target[r] = label[r] - f[r];
+      hessian[r] = 1;
+    }
+  }
+
+  double GetTotalLoss(const Dataset &d, const size_t *rows, size_t n, const ValueType *f) const {
+    const ValueType *label = &d.label[0];
+    const ValueType *weight = &d.weight[0];
+    double s = 0;
+    for (size_t j = 0; j < n; ++j) {
+      size_t r = rows[j];
+      s += Squared(label[r]-f[r]) * 0.5 * weight[r];
+    }
+    return s;
+  }
+
+  bool HasHessian() const { return true; }
 };
 
 DECLARE_OBJECTIVE_REGISTRATION(SquaredError)
@@ -153,6 +229,9 @@ DECLARE_OBJECTIVE_REGISTRATION(SquaredError)
 //
 // Optimal terminal node value (approximated):
 // rj = sum_{i \in Rj}(di) / sum_{i \in Rj}(|di|(2-|di|))
+//
+// Hessian:
+// h = |d|(2-|d|)
 ///////////////////////////////////////////////////////////////////////
 
 class LogLoss: public Objective {
@@ -198,6 +277,50 @@ class LogLoss: public Objective {
       return static_cast<ValueType> (s / c);
     }
   }
+
+  double GetBias(const Dataset &d, const size_t *rows, size_t len) const {
+    double s = 0;
+    double c = 0;
+    for (size_t i = 0; i < len; ++i) {
+      s += d.label[rows[i]] * d.weight[rows[i]];
+      c += d.weight[rows[i]];
+    }
+
+    double v = s / c;
+    return static_cast<ValueType>(std::log((1+v) / (1-v)) / 2.0);
+  }
+
+  double GetLoss(const Dataset &d, size_t row, ValueType f) const {
+    return 2.0 * std::log(1 + std::exp(-2.0*d.label[row]*f));
+  }
+
+  void UpdateGradient(Dataset *d, size_t row, ValueType f) const {
+    d->target[row] = 2.0 * d->label[row] / (1 + std::exp(2.0*d->label[row]*f));
+  }
+
+  double GetRegionPrediction(const Dataset &d, const size_t *rows, size_t len) const {
+    double s = 0;
+    double c = 0;
+    for (size_t i = 0; i < len; ++i) {
+      size_t r = rows[i];
+      s += d.target[r] * d.weight[r];
+      double y = Abs(d.target[r]);
+      c += y*(2-y) * d.weight[r];
+    }
+
+    if (c == 0) {
+      return static_cast<ValueType>(0);
+    } else {
+      return static_cast<ValueType> (s / c);
+    }
+  }
+
+  // exp and log of a block of rows at a time by `VectorExp' and
+  // `VectorLog', see loss.cpp
+  void UpdateGradients(Dataset *d, const size_t *rows, size_t n, const ValueType *f) const;
+  double GetTotalLoss(const Dataset &d, const size_t *rows, size_t n, const ValueType *f) const;
+
+  bool HasHessian() const { return true; }
 };
 
 DECLARE_OBJECTIVE_REGISTRATION(LogLoss)
@@ -241,6 +364,42 @@ class LAD: public Objective {
     assert(d.size() >= len);
     return WeightedResidualMedian(d, len);
   }
+  double GetBias(const Dataset &d, const size_t *rows, size_t len) const {
+    return WeightedLabelMedian(d, rows, len);
+  }
+
+  double GetLoss(const Dataset &d, size_t row, ValueType f) const {
+    return Abs(d.label[row]-f);
+  }
+
+  void UpdateGradient(Dataset *d, size_t row, ValueType f) const {
+    d->residual[row] = d->label[row] - f;
+    d->target[row] = Sign(d->residual[row]);
+  }
+
+  void UpdateGradients(Dataset *d, const size_t *rows, size_t n, const ValueType *f) const {
+    const ValueType *label = &d->label[0];
+    ValueType *target = &d->target[0];
+    ValueType *residual = &d->residual[0];
+    for (size_t j = 0; j < n; ++j) {
+      size_t r = rows[j];
+      residual[r] = label[r] - f[r];
+      target[r] = Sign(residual[r]);
+    }
+  }
+
+  double GetTotalLoss(const Dataset &d, const size_t *rows, size_t n, const ValueType *f) const {
+    const ValueType *label = &d.label[0];
+    double s = 0;
+    for (size_t j = 0; j < n; ++j) {
+      s += Abs(label[rows[j]]-f[rows[j]]);
+    }
+    return s;
+  }
+
+  double GetRegionPrediction(const Dataset &d, const size_t *rows, size_t len) const {
+    return WeightedResidualMedian(d, rows, len);
+  }
 };
 
 DECLARE_OBJECTIVE_REGISTRATION(LAD)
@@ -1,5 +1,10 @@
 #include "loss.hpp"
+#include "dataset.hpp"
 #include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
 
 #include "cmd_option.hpp"
 using namespace gbdt;
@@ -15,5 +20,100 @@ int main(int argc, char **argv)
 
   LossFactory::GetInstance()->LoadSharedLib(custom_loss_so);
   LossFactory::GetInstance()->PrintAllCandidates();
+
+  // vectorized exp and log are within a few ulps, including the tail
+  // of an odd length, and saturate out of range
+  std::srand(0);
+  std::vector<double> x(10001), y(x.size());
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = (std::rand() / static_cast<double>(RAND_MAX) - 0.5) * 1500;
+  }
+  x[0] = 0;
+  x[1] = 709.7;
+  x[2] = -745;
+  VectorExp(&x[0], x.size(), &y[0]);
+  for (size_t i = 0; i < x.size(); ++i) {
+    double e = std::exp(x[i]);
+    assert(y[i] == e || std::fabs(y[i] - e) <= 1e-15 * e ||
+           (e < 1e-300 && std::fabs(y[i] - e) < 1e-310));
+  }
+  assert(y[0] == 1);
+  double big[] = {710, 1e10, -746, -1e10};
+  VectorExp(big, 4, big);
+  assert(std::isinf(big[0]) && std::isinf(big[1]) && big[2] == 0 && big[3] == 0);
+
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = std::exp(x[i] / 2);
+  }
+  x[0] = 1;
+  VectorLog(&x[0], x.size(), &y[0]);
+  for (size_t i = 0; i < x.size(); ++i) {
+    double l = std::log(x[i]);
+    assert(std::fabs(y[i] - l) <= 1e-15 * std::fabs(l) + 1e-300);
+  }
+  assert(y[0] == 0);
+
+  // batch gradients and losses agree with the row by row ones
+  Dataset d;
+  bool r = LoadDataFromFile("../../data/train.txt", &d, 3, true);
+  assert(r);
+  std::vector<size_t> rows;
+  std::vector<ValueType> f(d.Size());
+  for (size_t i = 0; i < d.Size(); ++i) {
+    f[i] = (std::rand() / static_cast<double>(RAND_MAX) - 0.5) * 40;
+    if (i % 3 != 0) {
+      rows.push_back(i);
+    }
+  }
+  const char *names[] = {"SquaredError", "LogLoss", "LAD"};
+  for (size_t k = 0; k < 3; ++k) {
+    Objective *loss = LossFactory::GetInstance()->Create(names[k]);
+    loss->UpdateGradients(&d, &rows[0], rows.size(), &f[0]);
+    double total = 0;
+    for (size_t j = 0; j < rows.size(); ++j) {
+      size_t i = rows[j];
+      ValueType target = d.target[i];
+      ValueType residual = d.residual[i];
+      loss->UpdateGradient(&d, i, f[i]);
+      assert(std::fabs(target - d.target[i]) <= 1e-14 && residual == d.residual[i]);
+      total += loss->GetLoss(d, i, f[i]);
+    }
+    double batch = loss->GetTotalLoss(d, &rows[0], rows.size(), &f[0]);
+    assert(std::fabs(batch - total) <= 1e-12 * total);
+    delete loss;
+  }
+
+  // weighted medians by selection agree with sorting, with distinct
+  // values and any weights or with ties and equal weights
+  for (int k = 0; k < 200; ++k) {
+    size_t n = 1 + std::rand() % 50;
+    bool ties = k % 2 == 1;
+    std::vector<WeightedValue> values(n);
+    for (size_t i = 0; i < n; ++i) {
+      values[i].value = ties? std::rand() % 5 : std::rand() / static_cast<double>(RAND_MAX);
+      values[i].weight = ties? 1 : std::rand() % 4;
+    }
+    std::vector<std::pair<ValueType, double> > sorted(n);
+    double all_weight = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sorted[i] = std::make_pair(values[i].value, values[i].weight);
+      all_weight += values[i].weight;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    ValueType expected = 0;
+    double w = 0;
+    for (size_t i = 0; i < n; ++i) {
+      w += sorted[i].second;
+      if (w * 2 > all_weight) {
+        expected = i > 0? (sorted[i].first + sorted[i-1].first) / 2 : sorted[i].first;
+        break;
+      }
+    }
+    ValueType median = 0;
+    bool found = WeightedSelect(&values, all_weight / 2, &median);
+    assert(found == (all_weight > 0) && median == expected);
+  }
+
+  std::cout << "loss ok" << std::endl;
   return 0;
 }
@@ -4,24 +4,231 @@
 #include "tree.hpp"
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MATH_UTIL_SIMD
+#include <immintrin.h>
+#endif
 
 namespace {
-struct ResidualCompare {
-  bool operator () (const gbdt::Tuple *t1, const gbdt::Tuple *t2) {
-    return t1->residual < t2->residual;
+// Weighted median as `WeightedSelect' with half of the total weight,
+// 0 if there is no positive weight.
+gbdt::ValueType WeightedMedian(std::vector<gbdt::WeightedValue> *values) {
+  double all_weight = 0.0;
+  for (size_t i = 0; i < values->size(); ++i) {
+    all_weight += (*values)[i].weight;
   }
-};
+  gbdt::ValueType weighted_median = 0.0;
+  gbdt::WeightedSelect(values, all_weight / 2, &weighted_median);
+  return weighted_median;
+}
 
-struct LabelCompare {
-  bool operator () (const gbdt::Tuple *t1, const gbdt::Tuple *t2) {
-    return t1->label < t2->label;
+gbdt::ValueType WeightedMedian(const gbdt::ValueType *v,
+                               const gbdt::ValueType *weight,
+                               const size_t *rows, size_t len) {
+  std::vector<gbdt::WeightedValue> values(len);
+  for (size_t i = 0; i < len; ++i) {
+    values[i].value = v[rows[i]];
+    values[i].weight = weight[rows[i]];
   }
+  return WeightedMedian(&values);
+}
+
+// exp(x) = 2^k exp(r) with k = round(x / ln2) and |r| <= ln2 / 2, where
+// ln2 is split into `kLn2Hi', whose multiples by k are exact, and
+// `kLn2Lo'. exp(r) is its Taylor polynomial of degree 12, which is off
+// by less than 2e-16 relatively. The kernels use the same operations
+// in the same order, without fused multiply-add, so that they agree to
+// the bit.
+const double kLog2E = 1.44269504088896338700e+00;
+const double kLn2Hi = 6.93147180369123816490e-01;
+const double kLn2Lo = 1.90821492927058770002e-10;
+const double kExpMax = 709.0;     // exp of it is finite, 2^k too
+const double kExpMin = -708.0;    // exp of it is normal
+const double kExpOverflow = 7.09782712893383973096e+02;
+const double kExpUnderflow = -7.45133219101941108420e+02;
+const int kExpDegree = 12;
+const double kExpCoefficients[kExpDegree + 1] = {   // 1 / i!
+  1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040,
+  1.0 / 40320, 1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600
 };
 
+// log(x) = e ln2 + log(m) with sqrt(1/2) <= m < sqrt(2), log(m) = 2
+// atanh(s) with s = (m - 1) / (m + 1), |s| < 0.172, whose series up to
+// s^19 is off by less than 1e-17 relatively.
+const double kSqrt2 = 1.41421356237309514547e+00;
+const int kLogTerms = 10;
+
+inline double Pow2(double k) {
+  uint64_t bits = static_cast<uint64_t>(static_cast<int64_t>(k) + 1023) << 52;
+  double r;
+  std::memcpy(&r, &bits, sizeof(r));
+  return r;
+}
+
+double ExpScalar(double x) {
+  if (!(x < kExpOverflow)) {
+    return x > 0? std::numeric_limits<double>::infinity() : x;
+  }
+  if (x < kExpUnderflow) {
+    return 0;
+  }
+  double c = std::min(std::max(x, kExpMin), kExpMax);
+  double k = std::nearbyint(c * kLog2E);
+  double r = (c - k * kLn2Hi) - k * kLn2Lo;
+  double p = kExpCoefficients[kExpDegree];
+  for (int i = kExpDegree - 1; i >= 0; --i) {
+    p = p * r + kExpCoefficients[i];
+  }
+  double y = p * Pow2(k);
+  // exp of the clamped part of x, at most a factor of 2 at both ends
+  return c == x? y : y * std::exp(x - c);
+}
+
+double LogScalar(double x) {
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  double e = static_cast<double>(static_cast<int64_t>(bits >> 52)) - 1023;
+  bits = (bits & ((static_cast<uint64_t>(1) << 52) - 1)) | (static_cast<uint64_t>(1023) << 52);
+  double m;
+  std::memcpy(&m, &bits, sizeof(m));
+  if (m > kSqrt2) {
+    m = m * 0.5;
+    e = e + 1;
+  }
+  double s = (m - 1) / (m + 1);
+  double s2 = s * s;
+  double p = 1.0 / (2 * kLogTerms - 1);
+  for (int i = kLogTerms - 2; i >= 0; --i) {
+    p = p * s2 + 1.0 / (2 * i + 1);
+  }
+  return e * kLn2Hi + (2 * s * p + e * kLn2Lo);
+}
+
+typedef void (*VectorFunc)(const double *x, size_t n, double *out);
+
+void ExpScalar(const double *x, size_t n, double *out) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = ExpScalar(x[i]);
+  }
+}
+
+void LogScalar(const double *x, size_t n, double *out) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = LogScalar(x[i]);
+  }
+}
+
+#ifdef MATH_UTIL_SIMD
+__attribute__((target("avx2")))
+void ExpAVX2(const double *x, size_t n, double *out) {
+  const __m256d log2e = _mm256_set1_pd(kLog2E);
+  const __m256d ln2hi = _mm256_set1_pd(kLn2Hi);
+  const __m256d ln2lo = _mm256_set1_pd(kLn2Lo);
+  const __m256d lo = _mm256_set1_pd(kExpMin);
+  const __m256d hi = _mm256_set1_pd(kExpMax);
+  // adding it leaves a small integer in the low bits of a double
+  const __m256d magic = _mm256_set1_pd(6755399441055744.0);   // 2^52 + 2^51
+  const __m256i bias = _mm256_set1_epi64x(1023);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    __m256d c = _mm256_min_pd(_mm256_max_pd(v, lo), hi);
+    // inputs out of [kExpMin, kExpMax] are rare, done one by one
+    if (_mm256_movemask_pd(_mm256_cmp_pd(c, v, _CMP_NEQ_UQ)) != 0) {
+      ExpScalar(x + i, 4, out + i);
+      continue;
+    }
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(c, log2e),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(c, _mm256_mul_pd(k, ln2hi)),
+                              _mm256_mul_pd(k, ln2lo));
+    __m256d p = _mm256_set1_pd(kExpCoefficients[kExpDegree]);
+    for (int d = kExpDegree - 1; d >= 0; --d) {
+      p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(kExpCoefficients[d]));
+    }
+    __m256i ki = _mm256_castpd_si256(_mm256_add_pd(k, magic));
+    __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(ki, bias), 52));
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(p, scale));
+  }
+  ExpScalar(x + i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void LogAVX2(const double *x, size_t n, double *out) {
+  const __m256i mantissa = _mm256_set1_epi64x((static_cast<int64_t>(1) << 52) - 1);
+  const __m256i one_exponent = _mm256_set1_epi64x(static_cast<int64_t>(1023) << 52);
+  // biased exponent to double: or-ed into the mantissa of 2^52
+  const __m256i two52_bits = _mm256_set1_epi64x(static_cast<int64_t>(0x4330000000000000LL));
+  const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+  const __m256d sqrt2 = _mm256_set1_pd(kSqrt2);
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d two = _mm256_set1_pd(2.0);
+  const __m256d bias = _mm256_set1_pd(1023.0);
+  const __m256d ln2hi = _mm256_set1_pd(kLn2Hi);
+  const __m256d ln2lo = _mm256_set1_pd(kLn2Lo);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i bits = _mm256_castpd_si256(_mm256_loadu_pd(x + i));
+    __m256d e = _mm256_sub_pd(
+        _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), two52_bits)),
+                      two52),
+        bias);
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissa), one_exponent));
+    __m256d big = _mm256_cmp_pd(m, sqrt2, _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, half), big);
+    e = _mm256_blendv_pd(e, _mm256_add_pd(e, one), big);
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(1.0 / (2 * kLogTerms - 1));
+    for (int d = kLogTerms - 2; d >= 0; --d) {
+      p = _mm256_add_pd(_mm256_mul_pd(p, s2), _mm256_set1_pd(1.0 / (2 * d + 1)));
+    }
+    __m256d r = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, s), p), _mm256_mul_pd(e, ln2lo));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(e, ln2hi), r));
+  }
+  LogScalar(x + i, n - i, out + i);
+}
+#endif
+
+VectorFunc SelectExp() {
+#ifdef MATH_UTIL_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ExpAVX2;
+  }
+#endif
+  return ExpScalar;
+}
+
+VectorFunc SelectLog() {
+#ifdef MATH_UTIL_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return LogAVX2;
+  }
+#endif
+  return LogScalar;
+}
+
 }
 
 namespace gbdt {
 
+void VectorExp(const double *x, size_t n, double *out) {
+  static const VectorFunc kernel = SelectExp();
+  kernel(x, n, out);
+}
+
+void VectorLog(const double *x, size_t n, double *out) {
+  static const VectorFunc kernel = SelectLog();
+  kernel(x, n, out);
+}
+
 bool AlmostEqual(ValueType v1, ValueType v2) {
   ValueType diff = Abs(v1-v2);
   if (diff < 1.0e-5)
@@ -83,59 +290,120 @@ double MAE(const DataVector &data, const PredictVector &predict, size_t len) {
   return s / c;
 }
 
-ValueType WeightedResidualMedian(DataVector &d, size_t len) {
+ValueType WeightedResidualMedian(const DataVector &d, size_t len) {
   assert(d.size() >= len);
-  // simplest implementation using sorting
-  // sophisticated approch to find the weighted median is selection algorithm(partition algorithm).
-  std::sort(d.begin(), d.begin() + len, ResidualCompare());
-  double all_weight = 0.0;
+  std::vector<WeightedValue> values(len);
   for (size_t i = 0; i < len; ++i) {
-    all_weight += d[i]->weight;
+    values[i].value = d[i]->residual;
+    values[i].weight = d[i]->weight;
   }
+  return WeightedMedian(&values);
+}
 
-  ValueType weighted_median = 0.0;
-  double weight = 0.0;
-  for (int i = 0; i < len; ++i) {
-    weight += d[i]->weight;
-    if (weight * 2 > all_weight) {
-      if (i-1 >= 0) {
-        weighted_median = (d[i]->residual + d[i-1]->residual) / 2.0;
+ValueType WeightedLabelMedian(const DataVector &d, size_t len) {
+  assert(d.size() >= len);
+  std::vector<WeightedValue> values(len);
+  for (size_t i = 0; i < len; ++i) {
+    values[i].value = d[i]->label;
+    values[i].weight = d[i]->weight;
+  }
+  return WeightedMedian(&values);
+}
+
+bool WeightedSelect(std::vector<WeightedValue> *values, double threshold,
+                    ValueType *result) {
+  // Three-way partitions of [lo, hi) around a pivot, keeping the one
+  // with the answer. `below' is the weight before `lo', `before' the
+  // largest value there.
+  WeightedValue *v = values->empty()? NULL : &(*values)[0];
+  size_t lo = 0;
+  size_t hi = values->size();
+  double below = 0.0;
+  bool has_before = false;
+  ValueType before = 0.0;
+  while (lo < hi) {
+    ValueType a = v[lo].value;
+    ValueType b = v[lo + (hi - lo) / 2].value;
+    ValueType c = v[hi - 1].value;
+    ValueType pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+    // [lo, lt) < pivot, [lt, i) == pivot, [gt, hi) > pivot
+    size_t lt = lo;
+    size_t i = lo;
+    size_t gt = hi;
+    double less = 0.0;
+    bool has_less = false;
+    ValueType max_less = 0.0;
+    while (i < gt) {
+      if (v[i].value < pivot) {
+        less += v[i].weight;
+        max_less = has_less? std::max(max_less, v[i].value) : v[i].value;
+        has_less = true;
+        std::swap(v[i++], v[lt++]);
+      } else if (pivot < v[i].value) {
+        std::swap(v[i], v[--gt]);
       } else {
-        weighted_median = d[i]->residual;
+        ++i;
       }
+    }
 
-      break;
+    if (below + less > threshold) {
+      hi = lt;
+      continue;
+    }
+    if (has_less) {
+      has_before = true;
+      before = max_less;
+    }
+    below += less;
+    for (size_t j = lt; j < gt; ++j) {
+      below += v[j].weight;
+      if (below > threshold) {
+        if (j > lt) {
+          *result = pivot;
+        } else {
+          *result = has_before? (pivot + before) / 2.0 : pivot;
+        }
+        return true;
+      }
     }
+    has_before = true;
+    before = pivot;
+    lo = gt;
   }
+  return false;
+}
 
-  return weighted_median;
+bool Same(const Dataset &data, const size_t *rows, size_t len) {
+  if (len <= 1)
+    return true;
+
+  ValueType t = data.target[rows[0]];
+  for (size_t i = 1; i < len; ++i) {
+    if (!AlmostEqual(t, data.target[rows[i]]))
+      return false;
+  }
+  return true;
 }
 
-ValueType WeightedLabelMedian(DataVector &d, size_t len) {
-  assert(d.size() >= len);
-  // simplest implementation using sorting
-  // sophisticated approch to find the weighted median is selection algorithm(partition algorithm).
-  std::sort(d.begin(), d.begin() + len, LabelCompare());
-  double all_weight = 0.0;
+ValueType Average(const Dataset &data, const size_t *rows, size_t len) {
+  if (len == 0)
+    return 0;
+  double s = 0;
+  double c = 0;
   for (size_t i = 0; i < len; ++i) {
-    all_weight += d[i]->weight;
+    s += data.target[rows[i]] * data.weight[rows[i]];
+    c += data.weight[rows[i]];
   }
+  return static_cast<ValueType>(s / c);
+}
 
-  ValueType weighted_median = 0.0;
-  double weight = 0.0;
-  for (int i = 0; i < len; ++i) {
-    weight += d[i]->weight;
-    if (weight * 2 > all_weight) {
-      if (i-1 >= 0) {
-        weighted_median = (d[i]->label + d[i-1]->label) / 2.0;
-      } else {
-        weighted_median = d[i]->label;
-      }
-      break;
-    }
-  }
+ValueType WeightedResidualMedian(const Dataset &d, const size_t *rows, size_t len) {
+  return WeightedMedian(&d.residual[0], &d.weight[0], rows, len);
+}
 
-  return weighted_median;
+ValueType WeightedLabelMedian(const Dataset &d, const size_t *rows, size_t len) {
+  return WeightedMedian(&d.label[0], &d.weight[0], rows, len);
 }
 
 }
@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include "data.hpp"
+#include "dataset.hpp"
 
 namespace gbdt {
 bool AlmostEqual(ValueType v1, ValueType v2);
@@ -15,8 +16,37 @@ ValueType Average(const DataVector &data, size_t len);
 double RMSE(const DataVector &data, const PredictVector &predict, size_t len);
 double MAE(const DataVector &data, const PredictVector &predict, size_t len);
 
-ValueType WeightedResidualMedian(DataVector &d, size_t len);
-ValueType WeightedLabelMedian(DataVector &d, size_t len);
+// Weighted medians of the first `len' tuples, which are left untouched.
+ValueType WeightedResidualMedian(const DataVector &d, size_t len);
+ValueType WeightedLabelMedian(const DataVector &d, size_t len);
+
+// Versions of the above over rows `rows[0, len)' of a dataset, the
+// dataset and `rows' are left untouched.
+bool Same(const Dataset &data, const size_t *rows, size_t len);
+ValueType Average(const Dataset &data, const size_t *rows, size_t len);
+ValueType WeightedResidualMedian(const Dataset &d, const size_t *rows, size_t len);
+ValueType WeightedLabelMedian(const Dataset &d, const size_t *rows, size_t len);
+
+struct WeightedValue {
+  ValueType value;
+  double weight;
+};
+
+// Walking `values' in ascending order, the first one at which the sum
+// of weights exceeds `threshold', averaged with the one before it if
+// any, e.g. the weighted median with half of the total weight. Found
+// by quickselect in expected linear time, `values' is reordered.
+// Returns false if the total weight does not exceed `threshold'.
+bool WeightedSelect(std::vector<WeightedValue> *values, double threshold,
+                    ValueType *result);
+
+// `out[i] = exp(x[i])' for `n' values, within a few ulps of `std::exp',
+// 0 or infinity out of the range of doubles. Four values are computed
+// at once with AVX2 when the cpu supports it, with the same result as
+// one by one. `out' may be `x'.
+void VectorExp(const double *x, size_t n, double *out);
+// `out[i] = log(x[i])' the same way, for positive normal `x[i]'.
+void VectorLog(const double *x, size_t n, double *out);
 
 inline
 double Logit(ValueType f) {
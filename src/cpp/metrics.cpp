@@ -3,42 +3,56 @@
 #include "auc.hpp"
 namespace gbdt {
 
-double Metrics::MeanAbsoluteError(DataVector &d, PredictVector &p, int len) {
-  double s = 0, c = 0;
-  for (int i = 0; i < len; ++i) {
-    s += Abs(d[i]->label - p[i]) * d[i]->weight;
-    c += d[i]->weight;
+bool MetricAccumulator::IsSupported(const std::string &metric) {
+  return metric == "mae" || metric == "mse" || metric == "auc" || metric == "logloss";
+}
+
+void MetricAccumulator::Add(ValueType label, ValueType weight, ValueType p) {
+  if (metric == "auc") {
+    auc.Add(Logit(p), label);
+    return;
   }
-  return s/c;
+
+  if (metric == "mae") {
+    s += Abs(label - p) * weight;
+  } else if (metric == "mse") {
+    s += Squared(label - p) * weight;
+  } else if (metric == "logloss") {
+    s += 2.0 * std::log(1 + std::exp(-2.0*label*p)) * weight;
+  }
+  c += weight;
 }
 
-double Metrics::MeanSquaredError(DataVector &d, PredictVector &p, int len) {
-  double s = 0, c = 0;
-  for (int i = 0; i < len; ++i) {
-    s += Squared(d[i]->label - p[i]) * d[i]->weight;
-    c += d[i]->weight;
+double MetricAccumulator::Result() {
+  if (metric == "auc") {
+    return auc.CalculateAuc();
   }
   return s/c;
 }
-double Metrics::AucScore(DataVector &d, PredictVector &p, int len) {
-  Auc auc;
+
+static double Accumulate(const std::string &metric, DataVector &d, PredictVector &p, int len) {
+  MetricAccumulator m(metric);
   for (int i = 0; i < len; ++i) {
-    double y = Logit(p[i]);
-    auc.Add(y, d[i]->label);
+    m.Add(d[i]->label, d[i]->weight, p[i]);
   }
+  return m.Result();
+}
 
-  return auc.CalculateAuc();
+double Metrics::MeanAbsoluteError(DataVector &d, PredictVector &p, int len) {
+  return Accumulate("mae", d, p, len);
 }
 
-double Metrics::LogLoss(DataVector &d, PredictVector &p, int len) {
-  double s = 0, c = 0;
-  for (int i = 0; i < len; ++i) {
-    s += 2.0 * std::log(1 + std::exp(-2.0*d[i]->label*p[i])) * d[i]->weight;
-    c += d[i]->weight;
-  }
-  return s/c;
+double Metrics::MeanSquaredError(DataVector &d, PredictVector &p, int len) {
+  return Accumulate("mse", d, p, len);
 }
 
+double Metrics::AucScore(DataVector &d, PredictVector &p, int len) {
+  return Accumulate("auc", d, p, len);
+}
+
+double Metrics::LogLoss(DataVector &d, PredictVector &p, int len) {
+  return Accumulate("logloss", d, p, len);
+}
 
 }  // gbdt
 
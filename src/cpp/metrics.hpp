@@ -4,9 +4,30 @@
 #include <map>
 #include <string>
 #include "data.hpp"
+#include "auc.hpp"
 
 namespace gbdt {
 
+// Metric computed row by row, e.g. while predictions are streamed.
+// `metric' is one of `mae', `mse', `auc' and `logloss'.
+class MetricAccumulator {
+ public:
+  explicit MetricAccumulator(const std::string &metric):
+      metric(metric), s(0), c(0) {}
+
+  static bool IsSupported(const std::string &metric);
+
+  void Add(ValueType label, ValueType weight, ValueType p);
+  double Result();
+
+ private:
+  std::string metric;
+  double s, c;
+  Auc auc;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricAccumulator);
+};
+
 class Metrics {
  public:
   static double MeanAbsoluteError(DataVector &d, PredictVector &p, int len);
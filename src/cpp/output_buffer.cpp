@@ -0,0 +1,107 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "output_buffer.hpp"
+#include <cmath>
+#include <stdint.h>
+
+namespace gbdt {
+
+__extension__ typedef unsigned __int128 uint128;
+
+size_t FormatFixed(double v, char *out) {
+  if (!(std::fabs(v) < 9e12)) {
+    return 0;
+  }
+
+  // v = m * 2^e exactly, then round m * 10^6 * 2^e to an integer
+  int e = 0;
+  double fraction = std::frexp(std::fabs(v), &e);
+  uint64_t m = static_cast<uint64_t>(std::ldexp(fraction, 53));
+  e -= 53;
+
+  const uint64_t kScale = 1000000;
+  uint128 scaled = static_cast<uint128>(m) * kScale;
+  uint64_t q = 0;
+  if (e >= 0) {
+    q = static_cast<uint64_t>(scaled << e);
+  } else if (e > -128) {
+    int s = -e;
+    q = static_cast<uint64_t>(scaled >> s);
+    uint128 remainder = scaled - (static_cast<uint128>(q) << s);
+    uint128 half = static_cast<uint128>(1) << (s - 1);
+    if (remainder > half || (remainder == half && (q & 1))) {
+      ++q;
+    }
+  }
+
+  char digits[24];
+  size_t n = 0;
+  uint64_t integer = q / kScale;
+  uint64_t decimals = q % kScale;
+  for (int i = 0; i < 6; ++i) {
+    digits[n++] = static_cast<char>('0' + decimals % 10);
+    decimals /= 10;
+  }
+  digits[n++] = '.';
+  do {
+    digits[n++] = static_cast<char>('0' + integer % 10);
+    integer /= 10;
+  } while (integer > 0);
+
+  size_t len = 0;
+  if (std::signbit(v)) {
+    out[len++] = '-';
+  }
+  while (n > 0) {
+    out[len++] = digits[--n];
+  }
+  return len;
+}
+
+bool OutputBuffer::Open(const std::string &path) {
+  Close();
+  file = std::fopen(path.c_str(), "wb");
+  return file != NULL;
+}
+
+void OutputBuffer::Close() {
+  if (file) {
+    Flush();
+    std::fclose(file);
+    file = NULL;
+  }
+}
+
+void OutputBuffer::Flush() {
+  if (used > 0) {
+    std::fwrite(&buffer[0], 1, used, file);
+    used = 0;
+  }
+}
+
+void OutputBuffer::AppendValue(double v) {
+  if (used + kFormatFixedSize > buffer.size()) {
+    Flush();
+  }
+  size_t n = FormatFixed(v, &buffer[used]);
+  if (n > 0) {
+    used += n;
+  } else {
+    // large or not finite, rare enough for printf
+    Append(std::to_string(v));
+  }
+}
+
+void OutputBuffer::AppendInteger(size_t v) {
+  char digits[24];
+  size_t n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v > 0);
+  while (n > 0) {
+    Append(digits[--n]);
+  }
+}
+
+}
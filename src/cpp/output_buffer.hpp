@@ -0,0 +1,65 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _OUTPUT_BUFFER_H_
+#define _OUTPUT_BUFFER_H_
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "util.hpp"
+
+namespace gbdt {
+
+// Format `v' as `std::to_string' (printf "%f") does, into `out' of at
+// least `kFormatFixedSize' bytes, without printf: six decimals of the
+// exact value, ties to even. Return the length, `out' is not
+// terminated, or 0 if `v' is not finite or not below 9e12.
+const size_t kFormatFixedSize = 32;
+size_t FormatFixed(double v, char *out);
+
+// Output file written through a large user-space buffer, which is
+// flushed only when it is full or closed.
+class OutputBuffer {
+ public:
+  explicit OutputBuffer(size_t capacity = 4 * 1024 * 1024):
+      file(NULL), buffer(capacity), used(0) {}
+  ~OutputBuffer() { Close(); }
+
+  bool Open(const std::string &path);
+  void Close();
+
+  void Append(const char *s, size_t n) {
+    if (used + n > buffer.size()) {
+      Flush();
+      if (n > buffer.size()) {
+        std::fwrite(s, 1, n, file);
+        return;
+      }
+    }
+    std::copy(s, s + n, &buffer[used]);
+    used += n;
+  }
+  void Append(const std::string &s) { Append(s.data(), s.size()); }
+  void Append(char c) {
+    if (used == buffer.size()) {
+      Flush();
+    }
+    buffer[used++] = c;
+  }
+  // `v' as `std::to_string'
+  void AppendValue(double v);
+  void AppendInteger(size_t v);
+
+ private:
+  void Flush();
+
+  std::FILE *file;
+  std::vector<char> buffer;
+  size_t used;
+
+  DISALLOW_COPY_AND_ASSIGN(OutputBuffer);
+};
+
+}
+
+#endif /* _OUTPUT_BUFFER_H_ */
@@ -0,0 +1,63 @@
+#include "output_buffer.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+using namespace gbdt;
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  // formatted exactly as `std::to_string', including ties to even
+  double values[] = {0, -0.0, 1, -1, 0.5, 1.0 / 128, 3.0 / 128, -5.0 / 128,
+                     0.0000005, 0.0000015, -1e-9, 1e-300, 123456.7890125,
+                     8.99e12, 4.9e-324, 2.5e-7};
+  std::vector<double> v(values, values + sizeof(values) / sizeof(values[0]));
+  std::srand(0);
+  for (int i = 0; i < 100000; ++i) {
+    double x = (std::rand() - RAND_MAX / 2.0) / (1 + std::rand() % 1000);
+    v.push_back(x * std::pow(10.0, std::rand() % 20 - 10));
+  }
+
+  for (size_t i = 0; i < v.size(); ++i) {
+    char s[kFormatFixedSize];
+    size_t n = FormatFixed(v[i], s);
+    if (std::fabs(v[i]) < 9e12) {
+      assert(std::string(s, n) == std::to_string(v[i]));
+    } else {
+      assert(n == 0);
+    }
+  }
+  char s[kFormatFixedSize];
+  assert(FormatFixed(1e13, s) == 0);
+  assert(FormatFixed(std::numeric_limits<double>::quiet_NaN(), s) == 0);
+
+  // a small buffer is flushed many times
+  std::string expected;
+  {
+    OutputBuffer output(64);
+    bool r = output.Open("output_buffer_unittest.txt");
+    assert(r);
+    UNUSED(r);
+    for (size_t i = 0; i < 1000; ++i) {
+      output.AppendInteger(i);
+      output.Append(' ');
+      output.AppendValue(v[i] * 1e10);
+      output.Append("\n");
+      expected += std::to_string(i) + " " + std::to_string(v[i] * 1e10) + "\n";
+    }
+  }
+  std::ifstream input("output_buffer_unittest.txt");
+  std::stringstream content;
+  content << input.rdbuf();
+  assert(content.str() == expected);
+  std::remove("output_buffer_unittest.txt");
+
+  std::cout << "output buffer ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,144 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "predict_pipeline.hpp"
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace gbdt {
+
+long PredictPipeline::Run(const std::string &input, BatchWriter *writer) {
+  std::ifstream stream(input.c_str());
+  if (!stream) {
+    return -1;
+  }
+
+  alive = 0;
+  rows = 0;
+  eof = false;
+
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread(&PredictPipeline::Write, this, writer));
+  for (int i = 0; i < workers; ++i) {
+    threads.push_back(std::thread(&PredictPipeline::Score, this));
+  }
+
+  Read(&stream);
+
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  return static_cast<long>(rows);
+}
+
+void PredictPipeline::Read(std::istream *stream) {
+  size_t n = 0;
+  size_t line = 0;
+  ScoredBatch *batch = NULL;
+  std::string l;
+  for (;;) {
+    bool more = static_cast<bool>(std::getline(*stream, l));
+    if (more) {
+      ++line;
+      Tuple *t = Tuple::FromString(l,
+                                   number_of_feature,
+                                   two_class_classification,
+                                   false,
+                                   sparse);
+      if (!t) {
+        std::cerr << "invalid line " << line << " skipped: " << l << std::endl;
+        continue;
+      }
+      if (!batch) {
+        batch = new ScoredBatch();
+        batch->first_row = n;
+      }
+      batch->rows.push_back(t);
+      ++n;
+    }
+
+    if (batch && (!more || batch->rows.size() >= batch_size)) {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (alive >= queue_depth) {
+        changed.wait(lock);
+      }
+      parsed.push_back(batch);
+      ++alive;
+      batch = NULL;
+      changed.notify_all();
+    }
+
+    if (!more) {
+      break;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  rows = n;
+  eof = true;
+  changed.notify_all();
+}
+
+void PredictPipeline::Score() {
+#ifdef USE_OPENMP
+  // the workers are the parallelism, `PredictBatch' runs in one thread
+  omp_set_num_threads(1);
+#endif
+
+  for (;;) {
+    ScoredBatch *batch = NULL;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (parsed.empty() && !eof) {
+        changed.wait(lock);
+      }
+      if (parsed.empty()) {
+        return;
+      }
+      batch = parsed.front();
+      parsed.pop_front();
+    }
+
+    batch->scores.resize(batch->rows.size());
+    gbdt.PredictBatch(&batch->rows[0], batch->rows.size(), &batch->scores[0]);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    scored[batch->first_row] = batch;
+    changed.notify_all();
+  }
+}
+
+void PredictPipeline::Write(BatchWriter *writer) {
+  size_t next = 0;
+  for (;;) {
+    ScoredBatch *batch = NULL;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (scored.find(next) == scored.end() && !(eof && alive == 0)) {
+        changed.wait(lock);
+      }
+      std::map<size_t, ScoredBatch *>::iterator iter = scored.find(next);
+      if (iter == scored.end()) {
+        return;
+      }
+      batch = iter->second;
+      scored.erase(iter);
+    }
+
+    writer->Write(*batch);
+    next += batch->rows.size();
+    CleanDataVector(&batch->rows);
+    delete batch;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    --alive;
+    changed.notify_all();
+  }
+}
+
+}
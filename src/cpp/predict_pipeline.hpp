@@ -0,0 +1,84 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _PREDICT_PIPELINE_H_
+#define _PREDICT_PIPELINE_H_
+#include <string>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include "data.hpp"
+#include "gbdt.hpp"
+
+namespace gbdt {
+
+// Consecutive rows of the input and their predictions
+struct ScoredBatch {
+  size_t first_row;
+  DataVector rows;
+  PredictVector scores;
+};
+
+// Receives the scored batches of `PredictPipeline', in input order.
+class BatchWriter {
+ public:
+  virtual ~BatchWriter() {}
+  virtual void Write(const ScoredBatch &batch) = 0;
+};
+
+// Predict a data file without loading it at once: a reader thread
+// parses batches of lines, worker threads score them with
+// `GBDT::PredictBatch' and a writer thread hands them over in input
+// order. At most `queue_depth' batches are alive at any time, so memory
+// does not depend on the size of the input.
+class PredictPipeline {
+ public:
+  PredictPipeline(const GBDT &gbdt, int number_of_feature, bool two_class_classification):
+      gbdt(gbdt),
+      number_of_feature(number_of_feature),
+      two_class_classification(two_class_classification),
+      batch_size(10000),
+      queue_depth(8),
+      workers(4),
+      sparse(false) {}
+
+  // all at least 1, smaller values are raised to 1
+  void SetBatchSize(size_t n) { batch_size = std::max<size_t>(n, 1); }
+  void SetQueueDepth(size_t n) { queue_depth = std::max<size_t>(n, 1); }
+  void SetWorkers(int n) { workers = std::max(n, 1); }
+  // parse rows as sparse tuples, see `Tuple::FromString'
+  void SetSparse(bool s) { sparse = s; }
+
+  // Return the number of rows read, or -1 if `input' cannot be read.
+  // Lines which are not valid rows are reported and skipped.
+  long Run(const std::string &input, BatchWriter *writer);
+
+ private:
+  void Read(std::istream *stream);
+  void Score();
+  void Write(BatchWriter *writer);
+
+  const GBDT &gbdt;
+  int number_of_feature;
+  bool two_class_classification;
+
+  size_t batch_size;
+  size_t queue_depth;
+  int workers;
+  bool sparse;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<ScoredBatch *> parsed;          // waiting for a worker
+  std::map<size_t, ScoredBatch *> scored;    // waiting for the writer, by first row
+  size_t alive;                              // batches read and not yet written
+  size_t rows;                               // rows read
+  bool eof;
+
+  DISALLOW_COPY_AND_ASSIGN(PredictPipeline);
+};
+
+}
+
+#endif /* _PREDICT_PIPELINE_H_ */
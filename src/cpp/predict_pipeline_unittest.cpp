@@ -0,0 +1,107 @@
+#include "predict_pipeline.hpp"
+#include <iostream>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+
+#include "loss.hpp"
+
+using namespace gbdt;
+
+// collect the batches, checking that they come in input order
+class CollectWriter : public BatchWriter {
+ public:
+  void Write(const ScoredBatch &batch) {
+    assert(batch.first_row == scores.size());
+    assert(batch.rows.size() <= 1000);
+    scores.insert(scores.end(), batch.scores.begin(), batch.scores.end());
+  }
+
+  PredictVector scores;
+};
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  Configure conf;
+  conf.number_of_feature = 3;
+  conf.max_depth = 4;
+  conf.iterations = 10;
+  conf.shrinkage = 0.1;
+  conf.loss.reset(LossFactory::GetInstance()->Create("SquaredError"));
+
+  DataVector d;
+  bool r = LoadDataFromFile("../../data/test.txt",
+                            &d,
+                            conf.number_of_feature,
+                            false);
+  assert(r);
+
+  GBDT gbdt(conf);
+  gbdt.Fit(&d);
+
+  PredictVector expected(d.size());
+  gbdt.PredictBatch(&d[0], d.size(), &expected[0]);
+
+  PredictPipeline pipeline(gbdt, conf.number_of_feature, false);
+  pipeline.SetBatchSize(1000);
+  pipeline.SetQueueDepth(3);
+  pipeline.SetWorkers(4);
+
+  CollectWriter writer;
+  long n = pipeline.Run("../../data/test.txt", &writer);
+  assert(n == static_cast<long>(d.size()));
+  assert(writer.scores == expected);
+
+  // sparse rows are scored the same
+  pipeline.SetSparse(true);
+  CollectWriter sparse_writer;
+  n = pipeline.Run("../../data/test.txt", &sparse_writer);
+  assert(sparse_writer.scores == expected);
+
+  // and so are they by the forest of the used features only
+  GBDT loaded(conf);
+  loaded.Load(gbdt.Save());
+  PredictVector loaded_expected(d.size());
+  loaded.PredictBatch(&d[0], d.size(), &loaded_expected[0]);
+  Configure sparse_conf = conf;
+  sparse_conf.enable_sparse_input = true;
+  GBDT compact(sparse_conf);
+  compact.Load(gbdt.Save());
+  PredictPipeline compact_pipeline(compact, conf.number_of_feature, false);
+  compact_pipeline.SetBatchSize(1000);
+  compact_pipeline.SetSparse(true);
+  CollectWriter compact_writer;
+  n = compact_pipeline.Run("../../data/test.txt", &compact_writer);
+  assert(n == static_cast<long>(d.size()));
+  assert(compact_writer.scores == loaded_expected);
+
+  // invalid lines are skipped, and a queue depth or number of workers
+  // of 0 is raised to 1 instead of blocking
+  {
+    std::ifstream in("../../data/test.txt");
+    std::ofstream out("predict_pipeline_unittest.txt");
+    std::string l;
+    for (int i = 0; std::getline(in, l); ++i) {
+      if (i == 3) {
+        out << "\n" << "7\n";
+      }
+      out << l << "\n";
+    }
+  }
+  pipeline.SetSparse(false);
+  pipeline.SetQueueDepth(0);
+  pipeline.SetWorkers(0);
+  CollectWriter skip_writer;
+  n = pipeline.Run("predict_pipeline_unittest.txt", &skip_writer);
+  assert(n == static_cast<long>(d.size()));
+  assert(skip_writer.scores == expected);
+  std::remove("predict_pipeline_unittest.txt");
+  UNUSED(n);
+
+  std::cout << "predict pipeline ok" << std::endl;
+
+  CleanDataVector(&d);
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "quantile_sketch.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace gbdt {
+
+namespace {
+// weight of the values less than the entry, at least and at most
+inline double RMinNext(const QuantileSketch::Entry &e) { return e.rmin + e.w; }
+inline double RMaxPrev(const QuantileSketch::Entry &e) { return e.rmax - e.w; }
+
+inline QuantileSketch::Entry MakeEntry(ValueType value, double rmin, double rmax, double w) {
+  QuantileSketch::Entry e;
+  e.value = value;
+  e.rmin = rmin;
+  e.rmax = rmax;
+  e.w = w;
+  return e;
+}
+}
+
+QuantileSketch::QuantileSketch(size_t max_size):
+    max_size(max_size), buffer_size(4 * max_size) {
+  assert(max_size > 2);
+}
+
+void QuantileSketch::Merge(const QuantileSketch &other) {
+  // buffered values of `other' as an exact summary
+  QuantileSketch copy(other.max_size);
+  copy.buffer = other.buffer;
+  copy.summary = other.summary;
+  copy.Flush();
+  Flush();
+  Combine(copy.summary);
+  Prune();
+}
+
+void QuantileSketch::Flush() {
+  if (buffer.empty()) {
+    return;
+  }
+  std::sort(buffer.begin(), buffer.end());
+  std::vector<Entry> exact;
+  double acc = 0;
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    if (!exact.empty() && exact.back().value == buffer[i].first) {
+      exact.back().w += buffer[i].second;
+      exact.back().rmax += buffer[i].second;
+    } else {
+      exact.push_back(MakeEntry(buffer[i].first, acc, acc + buffer[i].second, buffer[i].second));
+    }
+    acc += buffer[i].second;
+  }
+  buffer.clear();
+  Combine(exact);
+  Prune();
+}
+
+void QuantileSketch::Combine(const std::vector<Entry> &other) {
+  if (other.empty()) {
+    return;
+  }
+  if (summary.empty()) {
+    summary = other;
+    return;
+  }
+
+  // the rank bounds of an entry grow by the bounds of the other
+  // summary's weight below its value
+  const std::vector<Entry> &a = summary;
+  const std::vector<Entry> &b = other;
+  scratch.clear();
+  size_t i = 0, j = 0;
+  double a_prev_rmin = 0, b_prev_rmin = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i].value == b[j].value) {
+      scratch.push_back(MakeEntry(a[i].value, a[i].rmin + b[j].rmin,
+                                  a[i].rmax + b[j].rmax, a[i].w + b[j].w));
+      a_prev_rmin = RMinNext(a[i++]);
+      b_prev_rmin = RMinNext(b[j++]);
+    } else if (a[i].value < b[j].value) {
+      scratch.push_back(MakeEntry(a[i].value, a[i].rmin + b_prev_rmin,
+                                  a[i].rmax + RMaxPrev(b[j]), a[i].w));
+      a_prev_rmin = RMinNext(a[i++]);
+    } else {
+      scratch.push_back(MakeEntry(b[j].value, b[j].rmin + a_prev_rmin,
+                                  b[j].rmax + RMaxPrev(a[i]), b[j].w));
+      b_prev_rmin = RMinNext(b[j++]);
+    }
+  }
+  for (; i < a.size(); ++i) {
+    scratch.push_back(MakeEntry(a[i].value, a[i].rmin + b_prev_rmin,
+                                a[i].rmax + b.back().rmax, a[i].w));
+  }
+  for (; j < b.size(); ++j) {
+    scratch.push_back(MakeEntry(b[j].value, b[j].rmin + a_prev_rmin,
+                                b[j].rmax + a.back().rmax, b[j].w));
+  }
+  summary.swap(scratch);
+}
+
+void QuantileSketch::Prune() {
+  if (summary.size() <= max_size) {
+    return;
+  }
+
+  // keep the first and the last entries, and the ones closest to
+  // `max_size - 2' evenly spaced ranks in between
+  const std::vector<Entry> &s = summary;
+  double begin = s.front().rmax;
+  double range = s.back().rmin - begin;
+  size_t n = max_size - 1;
+  scratch.clear();
+  scratch.push_back(s.front());
+  size_t i = 1, last = 0;
+  for (size_t k = 1; k < n; ++k) {
+    double dx2 = 2 * (static_cast<double>(k) * range / static_cast<double>(n) + begin);
+    while (i < s.size() - 1 && dx2 >= s[i+1].rmax + s[i+1].rmin) {
+      ++i;
+    }
+    if (i == s.size() - 1) {
+      break;
+    }
+    size_t pick = dx2 < RMinNext(s[i]) + RMaxPrev(s[i+1])? i : i + 1;
+    if (pick != last) {
+      scratch.push_back(s[pick]);
+      last = pick;
+    }
+  }
+  if (last != s.size() - 1) {
+    scratch.push_back(s.back());
+  }
+  summary.swap(scratch);
+}
+
+}
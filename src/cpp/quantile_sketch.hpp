@@ -0,0 +1,58 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _QUANTILE_SKETCH_H_
+#define _QUANTILE_SKETCH_H_
+#include <vector>
+#include <utility>
+#include "data.hpp"
+
+namespace gbdt {
+
+// Streaming weighted quantile summary, as the weighted GK summary of
+// XGBoost. Values are buffered, and folded into a summary of at most
+// `max_size' entries, each with bounds of the weight of the values
+// below it. Summaries of different rows, e.g. of other threads, can
+// be merged.
+//
+// As long as there are at most `max_size' distinct values, the summary
+// is exact: one entry per value, with its exact weight and rank.
+class QuantileSketch {
+ public:
+  struct Entry {
+    ValueType value;
+    double rmin;     // min weight of the values less than `value'
+    double rmax;     // max weight of the values less than or equal to `value'
+    double w;        // weight of `value'
+  };
+
+  explicit QuantileSketch(size_t max_size);
+
+  void Add(ValueType v, double w) {
+    buffer.push_back(std::make_pair(v, w));
+    if (buffer.size() >= buffer_size) {
+      Flush();
+    }
+  }
+  void Merge(const QuantileSketch &other);
+
+  // Entries sorted by value, including the buffered values.
+  const std::vector<Entry> &Summary() {
+    Flush();
+    return summary;
+  }
+
+ private:
+  void Flush();
+  void Combine(const std::vector<Entry> &other);
+  void Prune();
+
+  size_t max_size;
+  size_t buffer_size;
+  std::vector<std::pair<ValueType, double> > buffer;
+  std::vector<Entry> summary;
+  std::vector<Entry> scratch;
+};
+
+}
+
+#endif /* _QUANTILE_SKETCH_H_ */
@@ -0,0 +1,71 @@
+#include "quantile_sketch.hpp"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace gbdt;
+
+// weight of `values' less than `v'
+static double RankOf(const std::vector<std::pair<ValueType, double> > &values, ValueType v) {
+  double r = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i].first < v) r += values[i].second;
+  }
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  // few distinct values are summarized exactly
+  QuantileSketch exact(16);
+  for (int i = 0; i < 1000; ++i) {
+    exact.Add(i % 10, 1 + i / 10 % 2);
+  }
+  const std::vector<QuantileSketch::Entry> &e = exact.Summary();
+  assert(e.size() == 10);
+  for (size_t i = 0; i < e.size(); ++i) {
+    double x = static_cast<double>(i);
+    assert(e[i].value == x && e[i].w == 150);
+    assert(e[i].rmin == 150 * x && e[i].rmax == 150 * (x + 1));
+  }
+
+  // sketches of parts merged, rank bounds hold and are tight
+  std::srand(0);
+  std::vector<std::pair<ValueType, double> > values;
+  const int kParts = 4;
+  const size_t kSize = 64;
+  std::vector<QuantileSketch> parts(kParts, QuantileSketch(kSize));
+  for (int i = 0; i < 100000; ++i) {
+    ValueType v = std::rand() % 50000 / 7.0;
+    double w = 1 + std::rand() % 5;
+    values.push_back(std::make_pair(v, w));
+    parts[i % kParts].Add(v, w);
+  }
+  for (int k = 1; k < kParts; ++k) {
+    parts[0].Merge(parts[k]);
+  }
+  const std::vector<QuantileSketch::Entry> &s = parts[0].Summary();
+  assert(s.size() <= kSize);
+  double total = 0;
+  for (size_t i = 0; i < values.size(); ++i) total += values[i].second;
+  assert(std::fabs(s.back().rmax - total) < 1e-6);
+
+  double max_gap = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    double r = RankOf(values, s[i].value);
+    assert(s[i].rmin <= r + 1e-6 && r + s[i].w <= s[i].rmax + 1e-6);
+    if (i > 0) {
+      max_gap = std::max(max_gap, s[i].rmax - s[i-1].rmin);
+    }
+  }
+  // every rank is close to an entry
+  assert(max_gap < 4 * total / kSize);
+
+  std::cout << "quantile sketch ok, max rank gap " << max_gap / total << std::endl;
+  return 0;
+}
@@ -0,0 +1,157 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#include "quick_scorer.hpp"
+#include <cassert>
+#include <algorithm>
+
+namespace gbdt {
+
+namespace {
+const int kMaxLeaves = 64;
+
+// bitvector with leaves `[begin, end)' cleared
+uint64_t ClearLeaves(int begin, int end) {
+  uint64_t bits = (end - begin == kMaxLeaves)? ~0ULL : ((1ULL << (end - begin)) - 1);
+  return ~(bits << begin);
+}
+}
+
+bool QuickScorer::ThresholdLess(const Condition &a, const Condition &b) {
+  return a.threshold < b.threshold;
+}
+
+int QuickScorer::CountLeaves(const Node *node) {
+  if (!node || node->leaf) {
+    return 1;
+  }
+  return CountLeaves(node->child[Node::LT]) +
+      CountLeaves(node->child[Node::GE]) +
+      CountLeaves(node->child[Node::UNKNOWN]);
+}
+
+void QuickScorer::AddNode(const Node *node, ValueType pred, int tree, int first) {
+  if (!node || node->leaf) {
+    leaves[leaf_offset[tree] + first] = node? node->pred : pred;
+    return;
+  }
+
+  int lt = CountLeaves(node->child[Node::LT]);
+  int ge = CountLeaves(node->child[Node::GE]);
+
+  size_t f = static_cast<size_t>(node->index);
+  if (ge_conditions.size() <= f) {
+    ge_conditions.resize(f + 1);
+    unknown_conditions.resize(f + 1);
+  }
+  Condition c = {node->value, tree, ClearLeaves(first, first + lt)};
+  ge_conditions[f].push_back(c);
+  c.mask = ClearLeaves(first, first + lt + ge);
+  unknown_conditions[f].push_back(c);
+
+  AddNode(node->child[Node::LT], node->pred, tree, first);
+  AddNode(node->child[Node::GE], node->pred, tree, first + lt);
+  AddNode(node->child[Node::UNKNOWN], node->pred, tree, first + lt + ge);
+}
+
+void QuickScorer::Build(RegressionTree * const *trees, size_t n) {
+  Clear();
+
+  for (size_t i = 0; i < n; ++i) {
+    const Node *root = trees[i]->GetRoot();
+    assert(root);
+    int count = CountLeaves(root);
+    if (count > kMaxLeaves) {
+      slot.push_back(-1);
+      large_index.push_back(static_cast<int>(large.NumberOfTrees()));
+      large.Add(*trees[i]);
+      continue;
+    }
+
+    int tree = static_cast<int>(leaf_offset.size());
+    slot.push_back(tree);
+    large_index.push_back(-1);
+    leaf_offset.push_back(static_cast<int>(leaves.size()));
+    leaves.resize(leaves.size() + count);
+    AddNode(root, root->pred, tree, 0);
+  }
+
+  ge_offset.push_back(0);
+  unknown_offset.push_back(0);
+  for (size_t f = 0; f < ge_conditions.size(); ++f) {
+    std::vector<Condition> &ge = ge_conditions[f];
+    std::stable_sort(ge.begin(), ge.end(), ThresholdLess);
+    for (size_t k = 0; k < ge.size(); ++k) {
+      ge_threshold.push_back(ge[k].threshold);
+      ge_tree.push_back(ge[k].tree);
+      ge_mask.push_back(ge[k].mask);
+    }
+    ge_offset.push_back(ge_threshold.size());
+
+    std::vector<Condition> &unknown = unknown_conditions[f];
+    for (size_t k = 0; k < unknown.size(); ++k) {
+      unknown_tree.push_back(unknown[k].tree);
+      unknown_mask.push_back(unknown[k].mask);
+    }
+    unknown_offset.push_back(unknown_tree.size());
+  }
+
+  ge_conditions.clear();
+  unknown_conditions.clear();
+}
+
+void QuickScorer::Clear() {
+  slot.clear();
+  large_index.clear();
+  large.Clear();
+  leaf_offset.clear();
+  leaves.clear();
+  ge_offset.clear();
+  ge_threshold.clear();
+  ge_tree.clear();
+  ge_mask.clear();
+  unknown_offset.clear();
+  unknown_tree.clear();
+  unknown_mask.clear();
+  ge_conditions.clear();
+  unknown_conditions.clear();
+}
+
+void QuickScorer::Predict(const ValueType *x, int nf, size_t n,
+                          ValueType scale, ValueType *out) const {
+  size_t features = ge_offset.size() - 1;
+  assert(features <= static_cast<size_t>(nf));
+
+  std::vector<uint64_t> v(leaf_offset.size());
+  for (size_t j = 0; j < n; ++j) {
+    const ValueType *row = x + j * nf;
+    std::fill(v.begin(), v.end(), ~0ULL);
+
+    for (size_t f = 0; f < features; ++f) {
+      ValueType value = row[f];
+      if (value == kUnknownValue) {
+        for (size_t k = unknown_offset[f]; k < unknown_offset[f+1]; ++k) {
+          v[unknown_tree[k]] &= unknown_mask[k];
+        }
+      } else {
+        // thresholds are sorted, stop at the first node sending the
+        // row to LT
+        size_t end = ge_offset[f+1];
+        for (size_t k = ge_offset[f]; k < end && !(value < ge_threshold[k]); ++k) {
+          v[ge_tree[k]] &= ge_mask[k];
+        }
+      }
+    }
+
+    for (size_t i = 0; i < slot.size(); ++i) {
+      ValueType p;
+      if (slot[i] >= 0) {
+        p = leaves[leaf_offset[slot[i]] + __builtin_ctzll(v[slot[i]])];
+      } else {
+        p = large.PredictTree(large_index[i], row);
+      }
+      out[j] += scale * p;
+    }
+  }
+}
+
+}
@@ -0,0 +1,91 @@
+// Author: qiyiping@gmail.com (Yiping Qi)
+
+#ifndef _QUICK_SCORER_H_
+#define _QUICK_SCORER_H_
+#include <vector>
+#include <stdint.h>
+#include "data.hpp"
+#include "tree.hpp"
+#include "flat_forest.hpp"
+
+namespace gbdt {
+
+// Inference engine scoring a list of regression trees feature by
+// feature, as in QuickScorer (Lucchese et al., SIGIR 2015).
+//
+// The leaves of a tree are numbered from left to right, children in
+// LT, GE, UNKNOWN order, and a row keeps one bitvector of the leaves
+// it may still reach in each tree. For a known value, every node on
+// that feature with `threshold <= value' sends the row to GE and clears
+// the leaves under its LT child. For an unknown value, every node on
+// that feature clears the leaves under its LT and GE children. The
+// leaf reached is then the lowest bit left in the tree's bitvector.
+//
+// A missing UNKNOWN child counts as a leaf with its parent's
+// prediction, as in `FlatForest'. Trees with more than 64 leaves do not
+// fit in a bitvector and are traversed instead.
+class QuickScorer {
+ public:
+  QuickScorer() {}
+
+  void Build(RegressionTree * const *trees, size_t n);
+  void Clear();
+
+  bool Empty() const { return slot.empty(); }
+  size_t NumberOfTrees() const { return slot.size(); }
+
+  // Add `scale' times the sum of the trees' predictions to `out' for
+  // `n' rows of `x', stored row by row with `nf' features each.
+  void Predict(const ValueType *x, int nf, size_t n,
+               ValueType scale, ValueType *out) const;
+
+ private:
+  // number of leaves under `node', the UNKNOWN child counted even if
+  // missing
+  static int CountLeaves(const Node *node);
+  // Number the leaves of the subtree under `node' from `first' and
+  // collect the masks of its nodes for tree `tree'.
+  void AddNode(const Node *node, ValueType pred, int tree, int first);
+
+  // A node on a feature: `mask' has zeros for the leaves which are not
+  // reachable when the node's test fails.
+  struct Condition {
+    ValueType threshold;
+    int tree;
+    uint64_t mask;
+  };
+  static bool ThresholdLess(const Condition &a, const Condition &b);
+
+  // `slot[i]' is the bitvector index of tree `i', or -1 if the tree is
+  // in `large'
+  std::vector<int> slot;
+  std::vector<int> large_index;    // index of tree `i' in `large'
+  FlatForest large;
+
+  // prediction of each leaf, for the trees with a bitvector
+  std::vector<int> leaf_offset;
+  std::vector<ValueType> leaves;
+
+  // GE conditions of feature `f' in
+  // `[ge_offset[f], ge_offset[f+1])', sorted by threshold
+  std::vector<size_t> ge_offset;
+  std::vector<ValueType> ge_threshold;
+  std::vector<int> ge_tree;
+  std::vector<uint64_t> ge_mask;
+
+  // UNKNOWN conditions of feature `f' in
+  // `[unknown_offset[f], unknown_offset[f+1])'
+  std::vector<size_t> unknown_offset;
+  std::vector<int> unknown_tree;
+  std::vector<uint64_t> unknown_mask;
+
+  // conditions collected by `AddNode', by feature
+  std::vector<std::vector<Condition> > ge_conditions;
+  std::vector<std::vector<Condition> > unknown_conditions;
+
+  DISALLOW_COPY_AND_ASSIGN(QuickScorer);
+};
+
+}
+
+#endif /* _QUICK_SCORER_H_ */
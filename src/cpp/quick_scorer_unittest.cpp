@@ -0,0 +1,65 @@
+#include "gbdt.hpp"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+
+#include "loss.hpp"
+
+using namespace gbdt;
+
+int main(int argc, char *argv[]) {
+  UNUSED(argc);
+  UNUSED(argv);
+
+  Configure conf;
+  conf.number_of_feature = 3;
+  conf.iterations = 10;
+  conf.shrinkage = 0.1;
+  conf.loss.reset(LossFactory::GetInstance()->Create("SquaredError"));
+
+  DataVector d;
+  bool r = LoadDataFromFile("../../data/train.txt",
+                            &d,
+                            conf.number_of_feature,
+                            false);
+  assert(r);
+
+  // make some values unknown, so that UNKNOWN children are grown
+  std::srand(0);
+  for (size_t i = 0; i < d.size(); ++i) {
+    if (std::rand() % 5 == 0) {
+      d[i]->feature[std::rand() % conf.number_of_feature] = kUnknownValue;
+    }
+  }
+
+  // shallow trees fit in bitvectors, deep ones are traversed
+  int depth[] = {4, 7};
+  for (int k = 0; k < 2; ++k) {
+    conf.max_depth = depth[k];
+    GBDT gbdt(conf);
+    gbdt.Fit(&d);
+
+    Configure qs_conf = conf;
+    qs_conf.enable_quick_scorer = true;
+    GBDT quick(qs_conf);
+    quick.Load(gbdt.Save());
+
+    // the same model as `quick', leaf values go through the text
+    GBDT loaded(conf);
+    loaded.Load(gbdt.Save());
+
+    PredictVector expected(d.size());
+    PredictVector p(d.size());
+    loaded.PredictBatch(&d[0], d.size(), &expected[0]);
+    quick.PredictBatch(&d[0], d.size(), &p[0]);
+    for (size_t i = 0; i < d.size(); ++i) {
+      assert(p[i] == quick.Predict(*d[i]));
+      assert(p[i] == expected[i]);
+    }
+  }
+
+  std::cout << "quick scorer ok" << std::endl;
+
+  CleanDataVector(&d);
+  return 0;
+}
@@ -5,53 +5,65 @@
 #include "util.hpp"
 #include "loss.hpp"
 #include <cassert>
+#include <sstream>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 namespace {
 
-struct TupleCompare {
-  TupleCompare(int i): index(i) {}
+struct RowCompare {
+  RowCompare(const gbdt::ValueType *v): v(v) {}
 
-  bool operator () (const gbdt::Tuple *t1, const gbdt::Tuple *t2) {
-    return t1->feature[index] < t2->feature[index];
+  bool operator () (size_t i, size_t j) {
+    return v[i] < v[j];
   }
 
-  int index;
+  const gbdt::ValueType *v;
 };
 
 }
 
 
 namespace gbdt {
-void RegressionTree::Fit(DataVector *data,
+void RegressionTree::Fit(const Dataset &data,
+                         size_t *rows,
                          size_t len,
                          Node *node,
                          size_t depth,
-                         double *gain) {
+                         double *gain,
+                         Histogram *hist) {
   size_t max_depth = conf.max_depth;
 
-  node->pred = conf.loss->GetRegionPrediction(*data, len);
+  node->pred = RegionPrediction(data, rows, len);
 
   if (max_depth == depth
-      || Same(*data, len)
+      || Same(data, rows, len)
       || len <= conf.min_leaf_size) {
-    node->leaf = true;
+    SetLeaf(node, rows, len, hist);
     return;
   }
 
   double g = 0.0;
-  if (!FindSplit(data, len, &(node->index), &(node->value), &g)) {
-    node->leaf = true;
+  if (!FindSplit(data, rows, len, hist, &(node->index), &(node->value), &g)) {
+    SetLeaf(node, rows, len, hist);
     return;
   }
 
-  DataVector out[Node::CHILDSIZE];
-
-  SplitData(*data, len, node->index, node->value, out);
-  if (out[Node::LT].empty() || out[Node::GE].empty()) {
-    node->leaf = true;
+  // rows of the children are consecutive slices of `rows'
+  size_t count[Node::CHILDSIZE];
+  SplitData(data, rows, len, node->index, node->value, count);
+  if (count[Node::LT] == 0 || count[Node::GE] == 0) {
+    SetLeaf(node, rows, len, hist);
     return;
   }
 
+  size_t *child_rows[Node::CHILDSIZE];
+  child_rows[Node::LT] = rows;
+  child_rows[Node::GE] = child_rows[Node::LT] + count[Node::LT];
+  child_rows[Node::UNKNOWN] = child_rows[Node::GE] + count[Node::GE];
+
   gain[node->index] += g;
 
   // increase feature cost if certain feature is used
@@ -59,18 +71,351 @@ void RegressionTree::Fit(DataVector *data,
     conf.feature_costs[node->index] += 1.0e-4;
   }
 
+  Histogram *child_hist[Node::CHILDSIZE] = {NULL, NULL, NULL};
+  if (hist) {
+    if (depth + 1 < max_depth) {
+      SplitHistogram(data, child_rows, count, hist, child_hist);
+    } else {
+      ReleaseHistogram(hist);
+    }
+  }
+
   node->child[Node::LT] = new Node();
   node->child[Node::GE] = new Node();
 
-  Fit(&out[Node::LT], out[Node::LT].size(),
-      node->child[Node::LT], depth+1, gain);
-  Fit(&out[Node::GE], out[Node::GE].size(),
-      node->child[Node::GE], depth+1, gain);
+  Fit(data, child_rows[Node::LT], count[Node::LT],
+      node->child[Node::LT], depth+1, gain, child_hist[Node::LT]);
+  Fit(data, child_rows[Node::GE], count[Node::GE],
+      node->child[Node::GE], depth+1, gain, child_hist[Node::GE]);
 
-  if (!out[Node::UNKNOWN].empty()) {
+  if (count[Node::UNKNOWN] > 0) {
     node->child[Node::UNKNOWN] = new Node();
-    Fit(&out[Node::UNKNOWN], out[Node::UNKNOWN].size(),
-        node->child[Node::UNKNOWN], depth+1, gain);
+    Fit(data, child_rows[Node::UNKNOWN], count[Node::UNKNOWN],
+        node->child[Node::UNKNOWN], depth+1, gain, child_hist[Node::UNKNOWN]);
+  }
+}
+
+void RegressionTree::Grow(const Dataset &data, size_t *rows, size_t len,
+                          Histogram *hist) {
+  if (conf.max_leaves > 0) {
+    FitLeafWise(data, rows, len, hist);
+  } else if (depth_first || conf.enable_feature_tunning) {
+    // every split changes the costs of the following ones
+    Fit(data, rows, len, root, 0, gain, hist);
+  } else {
+    FitLevelWise(data, rows, len, hist);
+  }
+}
+
+void RegressionTree::FitLevelWise(const Dataset &data, size_t *rows, size_t len,
+                                  Histogram *hist) {
+  size_t max_depth = conf.max_depth;
+  size_t min_leaf_size = conf.min_leaf_size;
+
+  std::vector<LevelNode> level(1);
+  level[0].node = root;
+  level[0].rows = rows;
+  level[0].len = len;
+  level[0].hist = hist;
+
+  for (size_t depth = 0; !level.empty(); ++depth) {
+    size_t m = level.size();
+
+    std::vector<char> open(m);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t i = 0; i < m; ++i) {
+      const LevelNode &x = level[i];
+      x.node->pred = RegionPrediction(data, x.rows, x.len);
+      open[i] = !(depth == max_depth
+                  || Same(data, x.rows, x.len)
+                  || x.len <= min_leaf_size);
+    }
+
+    // (node, feature) pairs of the open nodes, feature order of each
+    // node is the one of `FindSplit'
+    std::vector<size_t> task_node;
+    std::vector<int> task_feature;
+    std::vector<size_t> first_task(m + 1);
+    std::vector<int> fv;
+    for (size_t i = 0; i < m; ++i) {
+      first_task[i] = task_node.size();
+      if (!open[i]) {
+        continue;
+      }
+      SampleFeatures(&fv);
+      task_node.insert(task_node.end(), fv.size(), i);
+      task_feature.insert(task_feature.end(), fv.begin(), fv.end());
+    }
+    first_task[m] = task_node.size();
+
+    std::vector<HistogramBin> total(m);
+    for (size_t i = 0; i < m; ++i) {
+      if (open[i] && level[i].hist) {
+        total[i] = level[i].hist->Total();
+      }
+    }
+
+    size_t tasks = task_node.size();
+    std::vector<ValueType> v(tasks);
+    std::vector<double> impurity(tasks);
+    std::vector<double> g(tasks);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t k = 0; k < tasks; ++k) {
+      const LevelNode &x = level[task_node[k]];
+      if (x.hist) {
+        GetHistogramImpurity(*x.hist, total[task_node[k]], task_feature[k],
+                             &v[k], &impurity[k], &g[k]);
+      } else {
+        GetImpurity(data, x.rows, x.len, task_feature[k], &v[k], &impurity[k], &g[k]);
+      }
+    }
+
+    std::vector<double> node_gain(m, 0.0);
+    for (size_t i = 0; i < m; ++i) {
+      double best_fitness = std::numeric_limits<double>::max();
+      for (size_t k = first_task[i]; k < first_task[i+1]; ++k) {
+        if (best_fitness > impurity[k]) {
+          best_fitness = impurity[k];
+          level[i].node->index = task_feature[k];
+          level[i].node->value = v[k];
+          node_gain[i] = g[k];
+        }
+      }
+      open[i] = best_fitness != std::numeric_limits<double>::max();
+    }
+
+    std::vector<size_t> count(m * Node::CHILDSIZE, 0);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t i = 0; i < m; ++i) {
+      if (open[i]) {
+        const LevelNode &x = level[i];
+        SplitData(data, x.rows, x.len, x.node->index, x.node->value,
+                  &count[i * Node::CHILDSIZE]);
+      }
+    }
+
+    // children of the level, the histograms of all but the largest
+    // child of each node are built from rows
+    std::vector<LevelNode> next;
+    std::vector<size_t> build;
+    // children `next[first[k], first[k+1])' of the k-th node which
+    // splits its histogram, `next[largest[k]]' took it over
+    std::vector<size_t> first;
+    std::vector<size_t> largest_child;
+    for (size_t i = 0; i < m; ++i) {
+      const LevelNode &x = level[i];
+      const size_t *c = &count[i * Node::CHILDSIZE];
+      if (!open[i] || c[Node::LT] == 0 || c[Node::GE] == 0) {
+        SetLeaf(x.node, x.rows, x.len, x.hist);
+        continue;
+      }
+
+      gain[x.node->index] += node_gain[i];
+
+      bool split_hist = x.hist && depth + 1 < max_depth;
+      if (x.hist && !split_hist) {
+        ReleaseHistogram(x.hist);
+      }
+
+      int largest = Node::LT;
+      for (int j = Node::GE; j < Node::CHILDSIZE; ++j) {
+        if (c[j] > c[largest]) {
+          largest = j;
+        }
+      }
+
+      if (split_hist) {
+        first.push_back(next.size());
+      }
+      size_t *child_rows = x.rows;
+      for (int j = 0; j < Node::CHILDSIZE; ++j) {
+        if (c[j] == 0) {
+          continue;
+        }
+        x.node->child[j] = new Node();
+        LevelNode y;
+        y.node = x.node->child[j];
+        y.rows = child_rows;
+        y.len = c[j];
+        y.hist = NULL;
+        if (split_hist) {
+          if (j == largest) {
+            y.hist = x.hist;
+            largest_child.push_back(next.size());
+          } else {
+            y.hist = pool->Acquire();
+            build.push_back(next.size());
+          }
+        }
+        next.push_back(y);
+        child_rows += c[j];
+      }
+    }
+
+    if (!build.empty()) {
+      // large children are built by rows, the others in parallel over
+      // (child, bin column) pairs
+      std::vector<size_t> by_column;
+      for (size_t k = 0; k < build.size(); ++k) {
+        const LevelNode &y = next[build[k]];
+        if (y.hist->RowWise(data, y.len)) {
+          y.hist->Build(data, y.rows, y.len);
+        } else {
+          by_column.push_back(build[k]);
+        }
+      }
+
+      int n = data.NumberOfBinColumns();
+      size_t hist_tasks = by_column.size() * n;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (size_t k = 0; k < hist_tasks; ++k) {
+        const LevelNode &y = next[by_column[k / n]];
+        y.hist->Build(data, y.rows, y.len, static_cast<int>(k % n));
+      }
+
+      // the largest child subtracts its siblings from parent's
+      // histogram, as `SplitHistogram'
+      first.push_back(next.size());
+      size_t families = largest_child.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (size_t k = 0; k < families; ++k) {
+        Histogram *hist = next[largest_child[k]].hist;
+        for (size_t j = first[k]; j < first[k+1]; ++j) {
+          if (j != largest_child[k]) {
+            hist->Subtract(*next[j].hist);
+          }
+        }
+      }
+    }
+
+    level.swap(next);
+  }
+}
+
+void RegressionTree::FitLeafWise(const Dataset &data, size_t *rows, size_t len,
+                                 Histogram *hist) {
+  SplitQueue queue;
+  candidates = 0;
+  AddCandidate(data, rows, len, root, 0, hist, &queue);
+
+  size_t leaves = 1;
+  size_t max_leaves = conf.max_leaves;
+  while (!queue.empty()) {
+    SplitCandidate c = queue.top();
+    queue.pop();
+
+    Node *node = c.node;
+    size_t count[Node::CHILDSIZE] = {0, 0, 0};
+    if (leaves < max_leaves) {
+      SplitData(data, c.rows, c.len, node->index, node->value, count);
+    }
+    size_t children = 2 + (count[Node::UNKNOWN] > 0);
+    if (count[Node::LT] == 0 || count[Node::GE] == 0
+        || leaves + children - 1 > max_leaves) {
+      node->index = -1;
+      node->value = 0;
+      SetLeaf(node, c.rows, c.len, c.hist);
+      continue;
+    }
+    leaves += children - 1;
+
+    size_t *child_rows[Node::CHILDSIZE];
+    child_rows[Node::LT] = c.rows;
+    child_rows[Node::GE] = child_rows[Node::LT] + count[Node::LT];
+    child_rows[Node::UNKNOWN] = child_rows[Node::GE] + count[Node::GE];
+
+    gain[node->index] += c.gain;
+
+    if (conf.enable_feature_tunning) {
+      conf.feature_costs[node->index] += 1.0e-4;
+    }
+
+    Histogram *child_hist[Node::CHILDSIZE] = {NULL, NULL, NULL};
+    if (c.hist) {
+      if (c.depth + 1 < static_cast<size_t>(conf.max_depth)) {
+        SplitHistogram(data, child_rows, count, c.hist, child_hist);
+      } else {
+        ReleaseHistogram(c.hist);
+      }
+    }
+
+    for (int i = 0; i < Node::CHILDSIZE; ++i) {
+      if (count[i] == 0) {
+        continue;
+      }
+      node->child[i] = new Node();
+      AddCandidate(data, child_rows[i], count[i],
+                   node->child[i], c.depth + 1, child_hist[i], &queue);
+    }
+  }
+}
+
+void RegressionTree::AddCandidate(const Dataset &data, size_t *rows, size_t len,
+                                  Node *node, size_t depth, Histogram *hist,
+                                  SplitQueue *queue) {
+  node->pred = RegionPrediction(data, rows, len);
+
+  double g = 0.0;
+  if (depth == static_cast<size_t>(conf.max_depth)
+      || Same(data, rows, len)
+      || len <= static_cast<size_t>(conf.min_leaf_size)
+      || !FindSplit(data, rows, len, hist, &(node->index), &(node->value), &g)) {
+    SetLeaf(node, rows, len, hist);
+    return;
+  }
+
+  SplitCandidate c = {node, rows, len, depth, hist, g, candidates++};
+  queue->push(c);
+}
+
+void RegressionTree::SplitHistogram(const Dataset &data,
+                                    size_t *const *child_rows,
+                                    const size_t *count,
+                                    Histogram *hist,
+                                    Histogram **child_hist) {
+  // Only the smaller children are built from rows, the largest one
+  // takes over parent's histogram and subtracts its siblings.
+  int largest = Node::LT;
+  for (int i = Node::GE; i < Node::CHILDSIZE; ++i) {
+    if (count[i] > count[largest]) {
+      largest = i;
+    }
+  }
+
+  for (int i = 0; i < Node::CHILDSIZE; ++i) {
+    if (i == largest || count[i] == 0) {
+      continue;
+    }
+    child_hist[i] = pool->Acquire();
+    child_hist[i]->Build(data, child_rows[i], count[i]);
+    hist->Subtract(*child_hist[i]);
+  }
+  child_hist[largest] = hist;
+}
+
+void RegressionTree::SetLeaf(Node *node, const size_t *rows, size_t len, Histogram *hist) {
+  node->leaf = true;
+  ReleaseHistogram(hist);
+  if (leaf_pred) {
+    for (size_t i = 0; i < len; ++i) {
+      leaf_pred[rows[i]] = node->pred;
+    }
+  }
+}
+
+void RegressionTree::ReleaseHistogram(Histogram *hist) {
+  if (pool) {
+    pool->Release(hist);
   }
 }
 
@@ -78,13 +423,14 @@ ValueType RegressionTree::Predict(const Node *root, const Tuple &t) const {
   if (root->leaf) {
     return root->pred;
   }
-  if (t.feature[root->index] == kUnknownValue) {
+  ValueType v = t.Get(root->index);
+  if (v == kUnknownValue) {
     if (root->child[Node::UNKNOWN]) {
       return Predict(root->child[Node::UNKNOWN], t);
     } else {
       return root->pred;
     }
-  } else if (t.feature[root->index] < root->value) {
+  } else if (v < root->value) {
     return Predict(root->child[Node::LT], t);
   } else {
     return Predict(root->child[Node::GE], t);
@@ -95,14 +441,15 @@ ValueType RegressionTree::Predict(const Node *root, const Tuple &t, double *p) c
   if (root->leaf) {
     return root->pred;
   }
-  if (t.feature[root->index] == kUnknownValue) {
+  ValueType v = t.Get(root->index);
+  if (v == kUnknownValue) {
     if (root->child[Node::UNKNOWN]) {
       p[root->index] += (root->child[Node::UNKNOWN]->pred - root->pred);
       return Predict(root->child[Node::UNKNOWN], t, p);
     } else {
       return root->pred;
     }
-  } else if (t.feature[root->index] < root->value) {
+  } else if (v < root->value) {
     p[root->index] += (root->child[Node::LT]->pred - root->pred);
     return Predict(root->child[Node::LT], t, p);
   } else {
@@ -111,16 +458,129 @@ ValueType RegressionTree::Predict(const Node *root, const Tuple &t, double *p) c
   }
 }
 
+ValueType RegressionTree::Predict(const Node *root, const Dataset &data, size_t row) const {
+  if (root->leaf) {
+    return root->pred;
+  }
+  ValueType v = data.GetValue(root->index, row);
+  if (v == kUnknownValue) {
+    if (root->child[Node::UNKNOWN]) {
+      return Predict(root->child[Node::UNKNOWN], data, row);
+    } else {
+      return root->pred;
+    }
+  } else if (v < root->value) {
+    return Predict(root->child[Node::LT], data, row);
+  } else {
+    return Predict(root->child[Node::GE], data, row);
+  }
+}
+
 void RegressionTree::Fit(DataVector *data, size_t len) {
   assert(data->size() >= len);
+  Dataset d;
+  d.FromDataVector(*data, len, conf.number_of_feature);
+  if (conf.enable_histogram) {
+    d.Quantize(conf.max_bins, conf.enable_feature_bundling);
+  }
+
+  std::vector<size_t> rows(len);
+  for (size_t i = 0; i < len; ++i) {
+    rows[i] = i;
+  }
+  Fit(d, &rows[0], len);
+}
+
+void RegressionTree::FitDepthFirst(const Dataset &data, const size_t *rows, size_t len) {
+  depth_first = true;
+  Fit(data, rows, len);
+  depth_first = false;
+}
+
+void RegressionTree::Fit(const Dataset &data, const size_t *rows, size_t len,
+                         ValueType *pred) {
   delete root;
+  leaf_pred = pred;
   root = new Node();
   delete[] gain;
   gain = new double[conf.number_of_feature];
-  for (size_t i = 0; i < conf.number_of_feature; ++i) {
+  for (int i = 0; i < conf.number_of_feature; ++i) {
     gain[i] = 0.0;
   }
-  Fit(data, len, root, 0, gain);
+
+  // One buffer of row indices for the whole tree, every node works on
+  // a slice of it which is partitioned in place among its children.
+  std::vector<size_t> buffer(rows, rows + len);
+  split_buffer.resize(len);
+  row_begin = &buffer[0];
+
+  // with Newton steps, regions are weighed by their weighted hessians
+  newton = conf.enable_newton && conf.loss->HasHessian();
+  if (newton) {
+    cover_buffer.resize(data.Size());
+    for (size_t i = 0; i < len; ++i) {
+      size_t r = rows[i];
+      cover_buffer[r] = data.weight[r] * data.hessian[r];
+    }
+    cover = &cover_buffer[0];
+  } else {
+    cover = &data.weight[0];
+  }
+
+  if (!data.IsQuantized()) {
+    int threads = 1;
+#ifdef USE_OPENMP
+    threads = omp_get_max_threads();
+#endif
+    sort_buffers.assign(threads, std::vector<size_t>());
+  }
+
+  if (data.IsQuantized()) {
+    bin_mapper = &data.GetBinMapper();
+    HistogramPool histogram_pool(data, cover);
+    pool = &histogram_pool;
+    Histogram *hist = pool->Acquire();
+    hist->Build(data, &buffer[0], len);
+    Grow(data, &buffer[0], len, hist);
+    pool = NULL;
+    bin_mapper = NULL;
+  } else {
+    Grow(data, &buffer[0], len, NULL);
+  }
+
+  FreeVector(&split_buffer);
+  row_begin = NULL;
+  FreeVector(&sort_buffers);
+  FreeVector(&cover_buffer);
+  cover = NULL;
+  leaf_pred = NULL;
+}
+
+ValueType RegressionTree::RegionPrediction(const Dataset &data,
+                                           const size_t *rows, size_t len) const {
+  if (!newton) {
+    return conf.loss->GetRegionPrediction(data, rows, len);
+  }
+
+  // Newton step
+  double s = 0;
+  double c = conf.l2_regularization;
+  for (size_t i = 0; i < len; ++i) {
+    size_t r = rows[i];
+    s += data.target[r] * data.weight[r];
+    c += cover[r];
+  }
+  return c > 0? static_cast<ValueType>(s / c) : 0;
+}
+
+double RegressionTree::Impurity(double s, double ss, double c) const {
+  if (newton) {
+    // minus the loss reduction of a Newton step
+    double d = c + conf.l2_regularization;
+    return d > 0? -s*s/d : 0;
+  }
+  double fitness = c > 1? (ss - s*s/c) : 0;
+  return fitness < 0? 0 : fitness;
 }
 
 ValueType RegressionTree::Predict(const Tuple &t) const {
@@ -131,6 +591,10 @@ ValueType RegressionTree::Predict(const Tuple &t, double *p) const {
   return Predict(root, t, p);
 }
 
+ValueType RegressionTree::Predict(const Dataset &data, size_t row) const {
+  return Predict(root, data, row);
+}
+
 std::string RegressionTree::Save() const {
   std::vector<const Node *> nodes;
   std::map<const void *, size_t> position_map;
@@ -175,6 +639,34 @@ void RegressionTree::SaveAux(const Node *node,
   SaveAux(node->child[Node::UNKNOWN], nodes, position_map);
 }
 
+std::string RegressionTree::Compile(const std::string &name) const {
+  std::ostringstream out;
+  out << "double " << name << "(const double *x) {\n";
+  CompileAux(root, 1, &out);
+  out << "}\n";
+  return out.str();
+}
+
+void RegressionTree::CompileAux(const Node *node, int depth, std::ostream *out) const {
+  std::string indent(depth * 2, ' ');
+  if (node->leaf) {
+    *out << indent << "return " << DoubleLiteral(node->pred) << ";\n";
+    return;
+  }
+
+  *out << indent << "if (x[" << node->index << "] == kUnknownValue) {\n";
+  if (node->child[Node::UNKNOWN]) {
+    CompileAux(node->child[Node::UNKNOWN], depth + 1, out);
+  } else {
+    *out << indent << "  return " << DoubleLiteral(node->pred) << ";\n";
+  }
+  *out << indent << "} else if (x[" << node->index << "] < " << DoubleLiteral(node->value) << ") {\n";
+  CompileAux(node->child[Node::LT], depth + 1, out);
+  *out << indent << "} else {\n";
+  CompileAux(node->child[Node::GE], depth + 1, out);
+  *out << indent << "}\n";
+}
+
 void RegressionTree::Load(const std::string &s) {
   delete root;
   std::vector<std::string> vs;
@@ -216,31 +708,48 @@ void RegressionTree::Load(const std::string &s) {
 }
 
 
-bool RegressionTree::FindSplit(DataVector *data, size_t m,
-                               int *index, ValueType *value, double *gain) {
+void RegressionTree::SampleFeatures(std::vector<int> *features) {
   size_t n = conf.number_of_feature;
-  double best_fitness = std::numeric_limits<double>::max();
-
-  std::vector<int> fv;
+  features->clear();
   for (int i = 0; i < n; ++i) {
-    fv.push_back(i);
+    features->push_back(i);
   }
 
-  size_t fn = n;
   if (conf.feature_sample_ratio < 1) {
-    fn = static_cast<size_t>(n*conf.feature_sample_ratio);
-    std::random_shuffle(fv.begin(), fv.end());
+    std::random_shuffle(features->begin(), features->end());
+    features->resize(static_cast<size_t>(n*conf.feature_sample_ratio));
   }
+}
+
+bool RegressionTree::FindSplit(const Dataset &data,
+                               const size_t *rows, size_t m,
+                               const Histogram *hist,
+                               int *index, ValueType *value, double *gain) {
+  double best_fitness = std::numeric_limits<double>::max();
+
+  std::vector<int> fv;
+  SampleFeatures(&fv);
+  size_t fn = fv.size();
 
   ValueType *v = new ValueType[fn];
   double *impurity = new double[fn];
   double *g = new double[fn];
 
+  if (hist) {
+    HistogramBin total = hist->Total();
 #ifdef USE_OPENMP
 #pragma omp parallel for
 #endif
-  for (size_t k = 0; k < fn; ++k) {
-    GetImpurity(data, m, fv[k], &v[k], &impurity[k], &g[k]);
+    for (size_t k = 0; k < fn; ++k) {
+      GetHistogramImpurity(*hist, total, fv[k], &v[k], &impurity[k], &g[k]);
+    }
+  } else {
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+    for (size_t k = 0; k < fn; ++k) {
+      GetImpurity(data, rows, m, fv[k], &v[k], &impurity[k], &g[k]);
+    }
   }
 
   for (size_t k = 0; k < fn; ++k) {
@@ -258,26 +767,36 @@ bool RegressionTree::FindSplit(DataVector *data, size_t m,
   return best_fitness != std::numeric_limits<double>::max();
 }
 
-bool RegressionTree::GetImpurity(DataVector *data, size_t len,
+bool RegressionTree::GetImpurity(const Dataset &data,
+                                 const size_t *rows, size_t len,
                                  int index, ValueType *value,
                                  double *impurity, double *gain) {
   *impurity = std::numeric_limits<double>::max();
   *value = kUnknownValue;
   *gain = 0;
 
-  DataVector data_copy = DataVector(data->begin(), data->end());
+  const ValueType *feature = data.Column(index);
+  const ValueType *target = &data.target[0];
+  const ValueType *weight = &data.weight[0];
 
-  std::sort(data_copy.begin(), data_copy.begin() + len, TupleCompare(index));
+  int thread = 0;
+#ifdef USE_OPENMP
+  thread = omp_get_thread_num();
+#endif
+  std::vector<size_t> &sorted = sort_buffers[thread];
+  sorted.assign(rows, rows + len);
+  std::sort(sorted.begin(), sorted.end(), RowCompare(feature));
 
   size_t unknown = 0;
   double s = 0;
   double ss = 0;
   double c = 0;
 
-  while (unknown < len && data_copy[unknown]->feature[index] == kUnknownValue) {
-    s += data_copy[unknown]->target * data_copy[unknown]->weight;
-    ss += Squared(data_copy[unknown]->target) * data_copy[unknown]->weight;
-    c += data_copy[unknown]->weight;
+  while (unknown < len && feature[sorted[unknown]] == kUnknownValue) {
+    size_t r = sorted[unknown];
+    s += target[r] * weight[r];
+    ss += Squared(target[r]) * weight[r];
+    c += cover[r];
     unknown++;
   }
 
@@ -285,30 +804,28 @@ bool RegressionTree::GetImpurity(DataVector *data, size_t len,
     return false;
   }
 
-  double fitness0 = c > 1? (ss - s*s/c) : 0;
-  if (fitness0 < 0) {
-    // std::cerr << "fitness0 < 0: " << fitness0 << std::endl;
-    fitness0 = 0;
-  }
+  double fitness0 = Impurity(s, ss, c);
 
   s = 0;
   ss = 0;
   c = 0;
   for (size_t j = unknown; j < len; ++j) {
-    s += data_copy[j]->target * data_copy[j]->weight;
-    ss += Squared(data_copy[j]->target) * data_copy[j]->weight;
-    c += data_copy[j]->weight;
+    size_t r = sorted[j];
+    s += target[r] * weight[r];
+    ss += Squared(target[r]) * weight[r];
+    c += cover[r];
   }
 
-  double fitness00 = c > 1? (ss - s*s/c) : 0;
+  double fitness00 = newton? Impurity(s, ss, c) : (c > 1? (ss - s*s/c) : 0);
 
   double ls = 0, lss = 0, lc = 0;
   double rs = s, rss = ss, rc = c;
   double fitness1 = 0, fitness2 = 0;
   for (size_t j = unknown; j < len-1; ++j) {
-    s = data_copy[j]->target * data_copy[j]->weight;
-    ss = Squared(data_copy[j]->target) * data_copy[j]->weight;
-    c = data_copy[j]->weight;
+    size_t r = sorted[j];
+    s = target[r] * weight[r];
+    ss = Squared(target[r]) * weight[r];
+    c = cover[r];
 
     ls += s;
     lss += ss;
@@ -318,22 +835,82 @@ bool RegressionTree::GetImpurity(DataVector *data, size_t len,
     rss -= ss;
     rc -= c;
 
-    ValueType f1 = data_copy[j]->feature[index];
-    ValueType f2 = data_copy[j+1]->feature[index];
+    ValueType f1 = feature[r];
+    ValueType f2 = feature[sorted[j+1]];
     if (AlmostEqual(f1, f2))
       continue;
 
-    fitness1 = lc > 1? (lss - ls*ls/lc) : 0;
-    if (fitness1 < 0) {
-      // std::cerr << "fitness1 < 0: " << fitness1 << std::endl;
-      fitness1 = 0;
+    fitness1 = Impurity(ls, lss, lc);
+    fitness2 = Impurity(rs, rss, rc);
+
+    double fitness = fitness0 + fitness1 + fitness2;
+
+    if (conf.enable_feature_tunning) {
+      fitness *= conf.feature_costs[index];
     }
 
-    fitness2 = rc > 1? (rss - rs*rs/rc) : 0;
-    if (fitness2 < 0) {
-      // std::cerr << "fitness2 < 0: " << fitness2 << std::endl;
-      fitness2 = 0;
+    if (*impurity > fitness) {
+      *impurity = fitness;
+      *value = (f1+f2)/2;
+      *gain = fitness00 - fitness1 - fitness2;
     }
+  }
+
+  return *impurity != std::numeric_limits<double>::max();
+}
+
+bool RegressionTree::GetHistogramImpurity(const Histogram &hist,
+                                          const HistogramBin &total,
+                                          int index, ValueType *value,
+                                          double *impurity, double *gain) {
+  *impurity = std::numeric_limits<double>::max();
+  *value = kUnknownValue;
+  *gain = 0;
+
+  const HistogramBin *h = hist.Feature(index);
+  size_t nb = hist.NumBins(index);
+
+  // bin 0 holds the unknown values
+  HistogramBin unknown = hist.Unknown(index, total);
+  double fitness0 = Impurity(unknown.s, unknown.ss, unknown.c);
+
+  double s = 0, ss = 0, c = 0;
+  size_t n = 0;
+  for (size_t b = 1; b < nb; ++b) {
+    s += h[b].s;
+    ss += h[b].ss;
+    c += h[b].c;
+    n += h[b].n;
+  }
+
+  if (n == 0) {
+    return false;
+  }
+
+  double fitness00 = newton? Impurity(s, ss, c) : (c > 1? (ss - s*s/c) : 0);
+
+  double ls = 0, lss = 0, lc = 0;
+  double rs = s, rss = ss, rc = c;
+  size_t rn = n;
+  double fitness1 = 0, fitness2 = 0;
+  for (size_t b = 1; b < nb-1; ++b) {
+    if (h[b].n == 0)
+      continue;
+
+    ls += h[b].s;
+    lss += h[b].ss;
+    lc += h[b].c;
+
+    rs -= h[b].s;
+    rss -= h[b].ss;
+    rc -= h[b].c;
+    rn -= h[b].n;
+
+    if (rn == 0)
+      break;
+
+    fitness1 = Impurity(ls, lss, lc);
+    fitness2 = Impurity(rs, rss, rc);
 
     double fitness = fitness0 + fitness1 + fitness2;
 
@@ -343,7 +920,7 @@ bool RegressionTree::GetImpurity(DataVector *data, size_t len,
 
     if (*impurity > fitness) {
       *impurity = fitness;
-      *value = (f1+f2)/2;
+      *value = bin_mapper->UpperBound(index, static_cast<BinType>(b));
       *gain = fitness00 - fitness1 - fitness2;
     }
   }
@@ -351,17 +928,49 @@ bool RegressionTree::GetImpurity(DataVector *data, size_t len,
   return *impurity != std::numeric_limits<double>::max();
 }
 
-void RegressionTree::SplitData(const DataVector &data, size_t len,
-                               int index, ValueType value, DataVector *output) {
-  for (size_t i = 0; i < len; ++i) {
-    if (data[i]->feature[index] == kUnknownValue) {
-      output[Node::UNKNOWN].push_back(data[i]);
-    } else if (data[i]->feature[index] < value) {
-      output[Node::LT].push_back(data[i]);
-    } else {
-      output[Node::GE].push_back(data[i]);
+void RegressionTree::SplitData(const Dataset &data,
+                               size_t *rows, size_t len,
+                               int index, ValueType value,
+                               size_t *count) {
+  // Stable partition: LT rows are compacted in place, GE rows are
+  // collected from the front of `split_buffer' and UNKNOWN rows from
+  // its back, then both are copied back behind the LT rows.
+  size_t lt = 0, ge = 0, unknown = 0;
+  size_t *buffer = &split_buffer[rows - row_begin];
+
+  if (data.IsQuantized()) {
+    // v < value iff its bin is less than the bin of value
+    BinType b = data.GetBinMapper().ValueToBin(index, value);
+    for (size_t i = 0; i < len; ++i) {
+      BinType x = data.GetBin(index, rows[i]);
+      if (x == 0) {
+        buffer[len - ++unknown] = rows[i];
+      } else if (x < b) {
+        rows[lt++] = rows[i];
+      } else {
+        buffer[ge++] = rows[i];
+      }
+    }
+  } else {
+    const ValueType *feature = data.Column(index);
+    for (size_t i = 0; i < len; ++i) {
+      ValueType v = feature[rows[i]];
+      if (v == kUnknownValue) {
+        buffer[len - ++unknown] = rows[i];
+      } else if (v < value) {
+        rows[lt++] = rows[i];
+      } else {
+        buffer[ge++] = rows[i];
+      }
     }
   }
+
+  std::copy(buffer, buffer + ge, rows + lt);
+  std::reverse_copy(buffer + len - unknown, buffer + len, rows + lt + ge);
+
+  count[Node::LT] = lt;
+  count[Node::GE] = ge;
+  count[Node::UNKNOWN] = unknown;
 }
 
 
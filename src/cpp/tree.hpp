@@ -3,9 +3,13 @@
 #ifndef _TREE_H_
 #define _TREE_H_
 #include <map>
+#include <queue>
 #include <vector>
+#include <iosfwd>
 #include "config.hpp"
 #include "data.hpp"
+#include "dataset.hpp"
+#include "histogram.hpp"
 
 namespace gbdt {
 class Node {
@@ -45,7 +49,10 @@ class Node {
 
 class RegressionTree {
  public:
-  RegressionTree(const Configure &conf): root(NULL), gain(NULL), conf(conf) {}
+  RegressionTree(const Configure &conf):
+      root(NULL), gain(NULL), conf(conf), bin_mapper(NULL), pool(NULL),
+      row_begin(NULL), leaf_pred(NULL), candidates(0), newton(false), cover(NULL),
+      depth_first(false) {}
   ~RegressionTree() {
     delete root;
     delete[] gain;
@@ -53,42 +60,152 @@ class RegressionTree {
 
   void Fit(DataVector *data) { Fit(data, data->size()); }
   void Fit(DataVector *data, size_t len);
+  // Fit rows `rows[0, len)' of `data'. Splits are found on histograms
+  // if `data' is quantized, by sorting feature values otherwise.
+  // If `pred' is not NULL, `pred[r]' is set to the prediction of the
+  // leaf which row `r' falls into, for every fitted row.
+  void Fit(const Dataset &data, const size_t *rows, size_t len,
+           ValueType *pred = NULL);
+  // Fit as above, depth-wise growth goes node by node in depth-first
+  // order, as with feature tuning, instead of level by level.
+  void FitDepthFirst(const Dataset &data, const size_t *rows, size_t len);
 
   ValueType Predict(const Tuple &t) const;
   ValueType Predict(const Tuple &t, double *p) const;
+  ValueType Predict(const Dataset &data, size_t row) const;
 
   std::string Save() const;
   void Load(const std::string &s);
+  // C++ source of a function `double name(const double *x)' returning
+  // the prediction of the tree, with the nodes unrolled into if/else.
+  std::string Compile(const std::string &name) const;
 
   double *GetGain() { return gain; }
+  const Node *GetRoot() const { return root; }
+  // Take over the nodes under `node' as the tree.
+  void SetRoot(Node *node) {
+    delete root;
+    root = node;
+  }
 
  private:
-  void Fit(DataVector *data,
+  // `hist' is the histogram of `rows' in histogram mode, NULL otherwise.
+  void Fit(const Dataset &data,
+           size_t *rows,
            size_t len,
            Node *node,
            size_t depth,
-           double *gain);
+           double *gain,
+           Histogram *hist);
+
+  // Grow the tree of `rows', with the growth policy of `conf'.
+  void Grow(const Dataset &data, size_t *rows, size_t len, Histogram *hist);
+
+  // A node of the level being grown in level-wise growth.
+  struct LevelNode {
+    Node *node;
+    size_t *rows;
+    size_t len;
+    Histogram *hist;
+  };
+
+  // Grow depth-wise one level at a time, the nodes of a level are
+  // handled together. Split search runs in parallel over all their
+  // (node, feature) pairs, so that a few features still keep all the
+  // threads busy. Without feature sampling, the tree is the same as
+  // the one of recursive `Fit'. Sampled features are drawn in
+  // breadth-first order, which takes other draws of the random
+  // sequence than the depth-first order of `Fit'.
+  void FitLevelWise(const Dataset &data, size_t *rows, size_t len, Histogram *hist);
+
+  // A node whose split is found, waiting to be applied in leaf-wise
+  // growth.
+  struct SplitCandidate {
+    Node *node;
+    size_t *rows;
+    size_t len;
+    size_t depth;
+    Histogram *hist;
+    double gain;
+    size_t order;   // breaks ties of `gain' by creation order
+
+    bool operator < (const SplitCandidate &other) const {
+      if (gain != other.gain) return gain < other.gain;
+      return order > other.order;
+    }
+  };
+  typedef std::priority_queue<SplitCandidate> SplitQueue;
+
+  // Grow best-first: always split the leaf with the largest gain, until
+  // there are `conf.max_leaves' leaves or no leaf can be split.
+  void FitLeafWise(const Dataset &data, size_t *rows, size_t len, Histogram *hist);
+  // Find the split of a new `node', make it a leaf if there is none.
+  void AddCandidate(const Dataset &data, size_t *rows, size_t len,
+                    Node *node, size_t depth, Histogram *hist,
+                    SplitQueue *queue);
+
+  void SplitHistogram(const Dataset &data,
+                      size_t *const *child_rows,
+                      const size_t *count,
+                      Histogram *hist,
+                      Histogram **child_hist);
+  void ReleaseHistogram(Histogram *hist);
+  // Prediction of a node of `rows': the objective's, or a Newton step.
+  ValueType RegionPrediction(const Dataset &data, const size_t *rows, size_t len) const;
+  // Impurity of a region from its sums of weighted targets, weighted
+  // squared targets and covers: the weighted squared error, or minus
+  // the loss reduction of a Newton step, `s^2 / (c + lambda)'.
+  double Impurity(double s, double ss, double c) const;
+  // Make `node' a leaf of `rows'.
+  void SetLeaf(Node *node, const size_t *rows, size_t len, Histogram *hist);
 
   ValueType Predict(const Node *node, const Tuple &t) const;
   ValueType Predict(const Node *node, const Tuple &t, double *p) const;
+  ValueType Predict(const Node *node, const Dataset &data, size_t row) const;
 
   void SaveAux(const Node *node,
                std::vector<const Node *> *nodes,
                std::map<const void *, size_t> *position_map) const;
+  void CompileAux(const Node *node, int depth, std::ostream *out) const;
 
  private:
-  bool FindSplit(DataVector *data, size_t len,
+  // Store the features to search for a split in `features', a random
+  // `conf.feature_sample_ratio' portion of them.
+  void SampleFeatures(std::vector<int> *features);
+  bool FindSplit(const Dataset &data, const size_t *rows, size_t len,
+                 const Histogram *hist,
                  int *index, ValueType *value, double *gain);
-  bool GetImpurity(DataVector *data, size_t len,
+  bool GetImpurity(const Dataset &data, const size_t *rows, size_t len,
                    int index, ValueType *value,
                    double *impurity, double *gain);
+  // `total' is `hist.Total()', shared by all the features of a node.
+  bool GetHistogramImpurity(const Histogram &hist, const HistogramBin &total,
+                            int index, ValueType *value,
+                            double *impurity, double *gain);
 
-  static void SplitData(const DataVector &data, size_t len, int index, ValueType value, DataVector *output);
+  // Partition `rows' in place into LT, GE and UNKNOWN slices, in that
+  // order, and store their sizes in `count'. `rows' is a slice of the
+  // rows buffer of `Fit', different slices can be split concurrently.
+  void SplitData(const Dataset &data, size_t *rows, size_t len,
+                 int index, ValueType value, size_t *count);
 
  private:
   Node *root;
   double *gain;
   Configure conf;
+  const BinMapper *bin_mapper;
+  HistogramPool *pool;
+
+  // scratch space, only alive during fitting
+  std::vector<size_t> split_buffer;   // indexed as the rows buffer starting at `row_begin'
+  const size_t *row_begin;
+  std::vector<std::vector<size_t> > sort_buffers;
+  ValueType *leaf_pred;
+  size_t candidates;
+  bool newton;                        // fitting by Newton steps
+  const ValueType *cover;             // weights, or weighted hessians of Newton steps
+  std::vector<ValueType> cover_buffer;
+  bool depth_first;                   // grow by recursive `Fit'
 
   DISALLOW_COPY_AND_ASSIGN(RegressionTree);
 };
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <cassert>
 #include <fstream>
+#include <cmath>
 
 #include "loss.hpp"
 
@@ -11,6 +12,19 @@
 
 using namespace gbdt;
 
+static size_t CountLeaves(const Node *node) {
+  if (node->leaf) {
+    return 1;
+  }
+  size_t n = 0;
+  for (int i = 0; i < Node::CHILDSIZE; ++i) {
+    if (node->child[i]) {
+      n += CountLeaves(node->child[i]);
+    }
+  }
+  return n;
+}
+
 int main(int argc, char *argv[]) {
 #ifdef USE_OPENMP
   const int threads_wanted = 4;
@@ -63,6 +77,82 @@ int main(int argc, char *argv[]) {
 
   std::cout << "rmse: " << RMSE(d2, predict) << std::endl;
 
+  // leaf-wise growth is bounded by leaves, not by depth
+  Configure leaf_conf = conf;
+  leaf_conf.max_depth = 20;
+  leaf_conf.max_leaves = 8;
+  RegressionTree leaf_tree(leaf_conf);
+  leaf_tree.Fit(&d);
+  assert(CountLeaves(leaf_tree.GetRoot()) <= 8);
+
+  RegressionTree leaf_tree2(leaf_conf);
+  leaf_tree2.Load(leaf_tree.Save());
+  assert(leaf_tree2.Save() == leaf_tree.Save());
+  predict.clear();
+  for (iter = d2.begin(); iter != d2.end(); ++iter) {
+    predict.push_back(leaf_tree2.Predict(**iter));
+  }
+  std::cout << "leaf-wise leaves: " << CountLeaves(leaf_tree.GetRoot())
+            << ", rmse: " << RMSE(d2, predict) << std::endl;
+
+  // level-wise growth gives the same trees as recursive growth, on
+  // values and on histograms
+  Dataset level_data;
+  level_data.FromDataVector(d, d.size(), conf.number_of_feature);
+  std::vector<size_t> level_rows(level_data.Size());
+  for (size_t i = 0; i < level_rows.size(); ++i) {
+    level_rows[i] = i;
+  }
+  std::vector<ValueType> level_score(level_data.Size(), 0);
+  Configure level_conf = conf;
+  level_conf.max_depth = 6;
+  level_conf.min_leaf_size = 2;
+  for (int quantized = 0; quantized < 2; ++quantized) {
+    if (quantized) {
+      level_data.Quantize(16);
+    }
+    level_conf.loss->UpdateGradients(&level_data, &level_rows[0], level_rows.size(),
+                                     &level_score[0]);
+    RegressionTree level_tree(level_conf);
+    level_tree.Fit(level_data, &level_rows[0], level_rows.size());
+    RegressionTree recursive_tree(level_conf);
+    recursive_tree.FitDepthFirst(level_data, &level_rows[0], level_rows.size());
+    assert(level_tree.Save() == recursive_tree.Save());
+    assert(CountLeaves(level_tree.GetRoot()) > 8);
+  }
+
+  // Newton steps of squared error without regularization grow the
+  // same tree, the hessian is 1
+  Dataset data;
+  data.FromDataVector(d, d.size(), conf.number_of_feature);
+  std::vector<size_t> rows(data.Size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    rows[i] = i;
+  }
+  std::vector<ValueType> score(data.Size(), 0);
+  conf.loss->UpdateGradients(&data, &rows[0], rows.size(), &score[0]);
+  Configure newton_conf = conf;
+  newton_conf.enable_newton = true;
+  newton_conf.l2_regularization = 0;
+  RegressionTree newton_tree(newton_conf);
+  newton_tree.Fit(data, &rows[0], rows.size());
+  RegressionTree plain_tree(conf);
+  plain_tree.Fit(data, &rows[0], rows.size());
+  assert(newton_tree.Save() == plain_tree.Save());
+
+  // a leaf is the sum of gradients over the sum of hessians plus the
+  // regularization
+  newton_conf.max_depth = 0;
+  newton_conf.l2_regularization = 100;
+  RegressionTree stump(newton_conf);
+  stump.Fit(data, &rows[0], rows.size());
+  double s = 0, c = newton_conf.l2_regularization;
+  for (size_t i = 0; i < data.Size(); ++i) {
+    s += data.target[i] * data.weight[i];
+    c += data.hessian[i] * data.weight[i];
+  }
+  assert(std::fabs(stump.GetRoot()->pred - s / c) < 1e-9);
+
   CleanDataVector(&d);
   CleanDataVector(&d2);
   return 0;
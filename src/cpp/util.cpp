@@ -1,6 +1,14 @@
 // Author: qiyiping@gmail.com (Yiping Qi)
 
 #include "util.hpp"
+#include <stdint.h>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace gbdt {
 
@@ -42,4 +50,62 @@ std::string JoinString(
   return result;
 }
 
+std::string DoubleLiteral(double v) {
+  if (v != v) {
+    return "std::numeric_limits<double>::quiet_NaN()";
+  }
+  if (v == std::numeric_limits<double>::infinity()) {
+    return "std::numeric_limits<double>::infinity()";
+  }
+  if (v == -std::numeric_limits<double>::infinity()) {
+    return "-std::numeric_limits<double>::infinity()";
+  }
+  std::ostringstream out;
+  // enough digits to read back the same doubles
+  out << std::setprecision(17) << v;
+  return out.str();
+}
+
+bool IsLittleEndian() {
+  uint32_t i = 1;
+  return *reinterpret_cast<char *>(&i) == 1;
+}
+
+bool MappedFile::Open(const std::string &path) {
+  Close();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  size = static_cast<size_t>(st.st_size);
+  if (size > 0) {
+    void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      size = 0;
+      close(fd);
+      return false;
+    }
+    data = static_cast<char *>(p);
+  }
+  // the mapping stays valid after the file is closed
+  close(fd);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data) {
+    munmap(data, size);
+  }
+  data = NULL;
+  size = 0;
+}
+
 }
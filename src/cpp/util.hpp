@@ -26,6 +26,33 @@ size_t SplitString(const std::string& str,
                    const std::string& separator,
                    std::vector<std::string>* tokens);
 
+// C++ literal of `v' which reads back the same double, including
+// infinities and NaN, which need `<limits>'.
+std::string DoubleLiteral(double v);
+
+// Binary files are written in the byte order of the machine, and only
+// read on little endian ones.
+bool IsLittleEndian();
+
+// Read only memory mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile(): data(NULL), size(0) {}
+  ~MappedFile() { Close(); }
+
+  bool Open(const std::string &path);
+  void Close();
+
+  const char *Data() const { return data; }
+  size_t Size() const { return size; }
+
+ private:
+  char *data;
+  size_t size;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
 template <typename T>
 void FreeVector(std::vector<T> *v) {
   std::vector<T> t;